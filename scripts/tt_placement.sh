@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compares the TT placement policies: the probe latency of 'tt bench' and
+# the nps of 'bench', for each value of the 'TT Placement' option.
+#
+# usage: tt_placement.sh [engine] [hash MB] [threads] [depth]
+
+engine=${1:-./stockfish}
+hash=${2:-4096}
+threads=${3:-$(nproc)}
+depth=${4:-13}
+
+for placement in FirstTouch Interleave Striped; do
+  output=$(printf 'setoption name Threads value %s\nsetoption name TT Placement value %s\nsetoption name Hash value %s\nisready\ntt bench\nbench %s %s %s\nquit\n' \
+             "$threads" "$placement" "$hash" "$hash" "$threads" "$depth" | "$engine" 2>&1)
+
+  latency=$(echo "$output" | grep "tt bench:" | sed 's/.*, \([0-9.e+-]*\) ns per probe/\1/')
+  nps=$(echo "$output" | grep "Nodes/second" | awk '{print $3}')
+  fallback=$(echo "$output" | grep -q "not available" && echo " (not available, ran FirstTouch)")
+
+  printf '%-10s %10s ns/probe %12s nps%s\n' "$placement" "$latency" "$nps" "$fallback"
+done
@@ -0,0 +1,247 @@
+#include "analyze.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "datagen.h"
+#include "engine.h"
+#include "misc.h"
+#include "search.h"
+#include "uci.h"
+#include "ucioption.h"
+
+namespace Stockfish::Analysis {
+
+namespace {
+
+constexpr int DefaultDepth = 10;
+
+bool is_number(const std::string& s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return std::isdigit(c); });
+}
+
+// Every castling right needs the king on its back rank and a rook of its colour
+// there on the side the letter names, which Position::set() looks for without
+// bounds. 'first' and 'last' are the eighth and the first rank of the board,
+// with the empty squares written out.
+bool castling_ok(const std::string& castling, const std::string& first, const std::string& last) {
+    if (castling == "-")
+        return true;
+
+    for (char c : castling)
+    {
+        const bool         white = std::isupper(static_cast<unsigned char>(c));
+        const std::string& rank  = white ? last : first;
+        const char         rook  = white ? 'R' : 'r';
+        const size_t       king  = rank.find(white ? 'K' : 'k');
+        const char         side  = char(std::toupper(static_cast<unsigned char>(c)));
+
+        if (king == std::string::npos)
+            return false;
+        if (side == 'K' ? rank.find(rook, king) == std::string::npos
+            : side == 'Q' ? rank.rfind(rook, king) == std::string::npos
+            : side >= 'A' && side <= 'H' ? rank[side - 'A'] != rook
+                                         : true)
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::string parse_fen(const std::string& line) {
+    std::istringstream is(line);
+    std::string        fields[6];
+    int                count = 0;
+
+    while (count < 6 && is >> fields[count])
+        ++count;
+
+    const std::string& board = fields[0];
+    if (count < 4 || (fields[1] != "w" && fields[1] != "b")
+        || board.find_first_not_of("pnbrqkPNBRQK12345678/") != std::string::npos
+        || std::count(board.begin(), board.end(), '/') != 7
+        || std::count(board.begin(), board.end(), 'K') != 1
+        || std::count(board.begin(), board.end(), 'k') != 1)
+        return "";
+
+    // Every rank must fill exactly eight squares
+    std::string rank, first, last;
+    for (char c : board + '/')
+        if (c == '/')
+        {
+            if (rank.size() != 8)
+                return "";
+            if (first.empty())
+                first = rank;
+            last = rank;
+            rank.clear();
+        }
+        else if (std::isdigit(c))
+            rank.append(c - '0', '.');
+        else
+            rank += c;
+
+    if (!castling_ok(fields[2], first, last))
+        return "";
+
+    std::string fen = board + ' ' + fields[1] + ' ' + fields[2] + ' ' + fields[3];
+    if (count == 6 && is_number(fields[4]) && is_number(fields[5]))
+        fen += ' ' + fields[4] + ' ' + fields[5];
+    return fen;
+}
+
+namespace {
+
+std::string to_json(size_t line, const Search::AnalysisResult& r) {
+    std::ostringstream os;
+    os << "{\"line\": " << line << ", \"fen\": \"" << r.fen << "\", \"depth\": " << r.depth
+       << ", \"seldepth\": " << r.selDepth << ", \"score\": \""
+       << UCIEngine::format_score(r.score) << "\", \"eval_score\": " << Datagen::to_cp(r.score)
+       << ", \"nodes\": " << r.nodes << ", \"bestmove\": \""
+       << (r.pv.empty() ? "(none)" : r.pv.substr(0, r.pv.find(' '))) << "\", \"pv\": \"" << r.pv
+       << "\"}";
+    return os.str();
+}
+
+// What the searching threads and the summary share once run() has returned
+struct Batch {
+    std::vector<size_t> lines;  // of each position in the file
+    std::string         output;
+    std::ofstream       out;
+    std::mutex          mutex;
+    uint64_t            nodes    = 0;
+    size_t              searched = 0;
+    size_t              skipped  = 0;
+    TimePoint           start    = 0;
+};
+
+}  // namespace
+
+void run(Engine& engine, std::istream& args) {
+    std::string        file, token;
+    int                threads = 0;
+    Search::LimitsType limits;
+    auto               batch = std::make_shared<Batch>();
+    bool               valid = bool(args >> file);
+
+    // Read as a signed number, so that a negative one is not wrapped around
+    auto read = [&](auto& value) {
+        using T = std::decay_t<decltype(value)>;
+        int64_t n;
+        valid = (args >> n) && n >= 1 && uint64_t(n) <= uint64_t(std::numeric_limits<T>::max());
+        if (valid)
+            value = T(n);
+    };
+    while (valid && args >> token)
+        if (token == "depth")
+            read(limits.depth);
+        else if (token == "nodes")
+            read(limits.nodes);
+        else if (token == "movetime")
+            read(limits.movetime);
+        else if (token == "threads")
+            read(threads);
+        else if (token == "output")
+            valid = bool(args >> batch->output);
+        else
+            valid = false;
+
+    if (!valid)
+    {
+        sync_cout << "info string usage: analyze <file> [depth N | nodes N | movetime N] "
+                     "[threads N] [output <file>]"
+                  << sync_endl;
+        return;
+    }
+
+    if (!limits.depth && !limits.nodes && !limits.movetime)
+        limits.depth = DefaultDepth;
+
+    std::ifstream in(file);
+    if (!in)
+    {
+        sync_cout << "info string analyze: cannot open " << file << sync_endl;
+        return;
+    }
+
+    std::vector<std::string> fens;
+    size_t                   lineNo = 0;
+    for (std::string line; std::getline(in, line);)
+    {
+        ++lineNo;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        const std::string fen = parse_fen(line);
+        if (fen.empty())
+            batch->skipped++;
+        else
+        {
+            fens.push_back(fen);
+            batch->lines.push_back(lineNo);
+        }
+    }
+
+    if (!batch->output.empty())
+    {
+        batch->out.open(batch->output);
+        if (!batch->out)
+        {
+            sync_cout << "info string analyze: cannot create " << batch->output << sync_endl;
+            return;
+        }
+    }
+
+    // The Threads option is restored once the run is over, which resizes the
+    // threads and the TT once more. A previous run restores it first.
+    engine.wait_for_search_finished();
+    OptionsMap&       options     = engine.get_options();
+    const int         userThreads = int(options["Threads"]);
+    const bool        setThreads  = threads && threads != userThreads;
+    auto              set_threads = [&options](int value) {
+        std::istringstream is("name Threads value " + std::to_string(value));
+        options.setoption(is);
+    };
+    if (setThreads)
+        set_threads(threads);
+
+    batch->start = now();
+    engine.analyze(
+      std::move(fens), limits,
+      [batch](const Search::AnalysisResult& r) {
+          const std::string json = to_json(batch->lines[r.index], r);
+
+          std::lock_guard<std::mutex> lk(batch->mutex);
+          batch->nodes += r.nodes;
+          batch->searched++;
+          if (batch->out.is_open())
+              batch->out << json << '\n';
+          else
+              sync_cout << json << sync_endl;
+      },
+      [batch, setThreads, userThreads, set_threads]() {
+          const TimePoint elapsed = now() - batch->start + 1;
+          if (setThreads)
+              set_threads(userThreads);
+          if (batch->out.is_open() && !batch->out.flush())
+              sync_cout << "info string analyze: failed to write " << batch->output << sync_endl;
+
+          sync_cout << "info string analyze: " << batch->searched << " positions ("
+                    << batch->skipped << " lines skipped) in " << elapsed / 1000.0 << " s, "
+                    << 1000.0 * batch->searched / elapsed << " positions/s, "
+                    << 1000 * batch->nodes / elapsed << " nodes/s" << sync_endl;
+      });
+}
+
+}  // namespace Stockfish::Analysis
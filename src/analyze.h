@@ -0,0 +1,44 @@
+#ifndef ANALYZE_H_INCLUDED
+#define ANALYZE_H_INCLUDED
+
+#include <iosfwd>
+#include <string>
+
+namespace Stockfish {
+
+class Engine;
+
+namespace Analysis {
+
+// analyze <file> [depth N | nodes N | movetime N] [threads N] [output <file>]
+//
+// Searches every position of an EPD or FEN file, one per line, without the
+// 'position' and 'go' round trip of each UCI search: every thread searches a
+// position of its own single-threaded and takes the next one when done,
+// sharing the TT and the networks (see ThreadPool::analyze()). 'threads' sets
+// the Threads option for this run only. Without a limit the positions are
+// searched to depth 10, and a number below 1 or an unknown argument prints the
+// usage instead. Like 'go' the run does not block the UCI loop: 'stop'
+// or 'quit' ends it, the running searches stop and the remaining positions
+// are not searched, and a command that needs the threads waits for it.
+//
+// One JSON object per position is written to 'output', or to stdout, in the
+// order the searches finish, for example
+//   {"line": 1, "fen": "...", "depth": 10, "seldepth": 14, "score": "cp 23",
+//    "eval_score": 23, "nodes": 21870, "bestmove": "e2e4", "pv": "e2e4 e7e5"}
+// where "line" is the position's line in the file, counted from 1, and
+// "eval_score" is the score as Datagen::to_cp() gives it, so that 'convert'
+// can pack the output. A summary line follows once the run is over.
+void run(Engine& engine, std::istream& args);
+
+// The FEN of an EPD or FEN line: the four position fields, then the move
+// counters if they follow, without the EPD operations. Empty if the position
+// is not one Position::set() can take, with eight squares on every rank, one
+// king of each colour and a rook for every castling right.
+std::string parse_fen(const std::string& line);
+
+}  // namespace Analysis
+
+}  // namespace Stockfish
+
+#endif  // ANALYZE_H_INCLUDED
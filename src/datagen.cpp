@@ -0,0 +1,415 @@
+#include "datagen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "harenn.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "score.h"
+#include "search.h"
+#include "uci.h"
+
+namespace Stockfish::Datagen {
+
+int to_cp(const Score& s) {
+    if (s.is<Score::Mate>())
+    {
+        const int plies = s.get<Score::Mate>().plies;
+        const int moves = (plies > 0 ? plies + 1 : plies) / 2;
+        return moves > 0 ? 10000 - moves : -10000 - moves;
+    }
+    if (s.is<Score::Tablebase>())
+    {
+        const auto tb = s.get<Score::Tablebase>();
+        return tb.win ? 20000 - tb.plies : -20000 - tb.plies;
+    }
+    return s.get<Score::InternalUnits>().value;
+}
+
+namespace {
+
+constexpr auto StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Game generation parameters of parallel_generate.py
+constexpr int MaxPlies          = 99;
+constexpr int OpeningPlies      = 6;  // positions up to here are not labelled
+constexpr int RandomMovePercent = 8;
+constexpr int PlayMoveTime      = 40;  // ms per played move
+constexpr int MultiPV           = 3;
+
+constexpr Bitboard DarkSquares = 0xAA55AA55AA55AA55ULL;
+
+// python-chess's is_insufficient_material(): neither side can mate, with K v K,
+// K+N v K, or kings and bishops that all stand on squares of one colour
+bool insufficient_material(const Position& pos) {
+    if (pos.pieces(PAWN, ROOK, QUEEN))
+        return false;
+    if (pos.pieces(KNIGHT))
+        return pos.count<ALL_PIECES>() == 3;
+    return !(pos.pieces(BISHOP) & DarkSquares) || !(pos.pieces(BISHOP) & ~DarkSquares);
+}
+
+// python-chess's is_game_over() without claims: mate, stalemate, insufficient
+// material, the 75-move rule or a fivefold repetition. 'states' holds the
+// StateInfo of every position of the game, the current one last.
+bool game_over(const Position& pos, const std::deque<StateInfo>& states) {
+    if (!MoveList<LEGAL>(pos).size() || insufficient_material(pos) || pos.rule50_count() >= 150)
+        return true;
+
+    // Earlier occurrences can only be found since the last irreversible move
+    const int reversible = std::min(pos.rule50_count(), int(states.size()) - 1);
+    int       seen       = 1;
+    for (int i = 2; i <= reversible; i += 2)
+        seen += states[states.size() - 1 - i].key == states.back().key;
+    return seen >= 5;
+}
+
+// First move and score of one principal variation. Scores are centipawns from
+// the side to move, mates count as +-(10000 - moves) like python-chess does.
+struct Line {
+    int         cp = 0;
+    std::string move;
+};
+
+struct TrainingPosition {
+    std::string              fen;
+    int                      stm;
+    int                      evalScore;
+    int                      depth;
+    std::vector<std::string> bestMoves[3];  // at depth, depth + 4 and depth + 8
+    std::vector<int>         bestMoveLabels[3];
+    int                      material;
+    int                      pieceCount;
+    double                   tau, rho, rs;
+};
+
+// The HARENN input feature of the moved piece on its destination, as
+// move_to_label() computes it. Castling moves the king to its usual square.
+int move_label(const Position& pos, const std::string& uci) {
+    const Move m = UCIEngine::to_move(pos, uci);
+    if (m == Move::none())
+        return 0;
+
+    Square to = m.to_sq();
+    if (m.type_of() == CASTLING)
+        to = relative_square(pos.side_to_move(), to > m.from_sq() ? SQ_G1 : SQ_C1);
+
+    return std::min(HARENN::feature_index(to, pos.moved_piece(m)), 767);
+}
+
+int material(const Position& pos) {
+    constexpr int Values[] = {0, 1, 3, 3, 5, 9, 0};
+
+    int total = 0;
+    for (PieceType pt : {PAWN, KNIGHT, BISHOP, ROOK, QUEEN})
+        total += Values[pt] * (popcount(pos.pieces(WHITE, pt)) - popcount(pos.pieces(BLACK, pt)));
+    return total;
+}
+
+double round4(double x) { return std::round(x * 10000) / 10000; }
+
+// Resolution score of calculate_rs(): endgames resolve, quiet balanced
+// middlegames partly, everything else barely
+double resolution_score(const Position& pos, int cp) {
+    const int pieceCount = popcount(pos.pieces());
+    if (pieceCount < 10)
+        return 1.0;
+    if (pieceCount < 16)
+        return 0.7;
+    if (!pos.checkers() && std::abs(cp) < 30)
+        return std::min(0.8, 0.4 + (30 - std::abs(cp)) / 100.0);
+    return 0.1;
+}
+
+template<typename T>
+void write_list(std::ostream& os, const std::vector<T>& list, bool quoted) {
+    os << '[';
+    for (std::size_t i = 0; i < list.size(); ++i)
+        os << (i ? ", " : "") << (quoted ? "\"" : "") << list[i] << (quoted ? "\"" : "");
+    os << ']';
+}
+
+void write_json(std::ostream& os, const TrainingPosition& p, int gameResult) {
+    const auto& m = p.bestMoves;
+    const auto& l = p.bestMoveLabels;
+
+    os << "{\"fen\": \"" << p.fen << "\", \"stm\": " << p.stm << ", \"eval_score\": " << p.evalScore
+       << ", \"depth\": " << p.depth << ", \"best_move\": \"" << (m[0].empty() ? "0000" : m[0][0])
+       << "\", \"best_move_label\": " << (l[0].empty() ? 0 : l[0][0]);
+
+    const char* depths[] = {"d16", "d20", "d24"};
+    for (int i = 0; i < 3; ++i)
+    {
+        os << ", \"best_moves_" << depths[i] << "\": ";
+        write_list(os, m[i], true);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        os << ", \"best_move_labels_" << depths[i] << "\": ";
+        write_list(os, l[i], false);
+    }
+
+    os << ", \"game_result\": " << gameResult << ", \"material\": " << p.material
+       << ", \"piece_count\": " << p.pieceCount << ", \"tau\": " << p.tau << ", \"rho\": " << p.rho
+       << ", \"rs\": " << p.rs << '}';
+}
+
+// A single-threaded engine that plays and labels one game at a time, with the
+// options of the engine that runs datagen
+class Worker {
+   public:
+    Worker(const std::string& binaryPath, const OptionsMap& options, int hash) :
+        engine(binaryPath) {
+        engine.get_options().copy_from(options, {"Threads", "Hash", "MultiPV", "Debug Log File"});
+
+        std::istringstream is("name Hash value " + std::to_string(hash));
+        engine.get_options().setoption(is);
+
+        engine.set_on_update_no_moves([](const auto&) {});
+        engine.set_on_iter([](const auto&) {});
+        engine.set_on_verify_networks([](auto) {});
+        engine.set_on_bestmove([this](std::string_view best, auto) { bestMove = best; });
+        engine.set_on_update_full([this](const Engine::InfoFull& info) {
+            if (info.multiPV > lines.size())
+                return;
+            Line& line = lines[info.multiPV - 1];
+            line.cp    = to_cp(info.score);
+            line.move  = std::string(info.pv.substr(0, info.pv.find(' ')));
+        });
+    }
+
+    // Plays a game and returns its labelled positions. 'result' is set to
+    // 2, 1 or 0 for a white win, a draw or unfinished game, and a black win.
+    std::vector<TrainingPosition> play(uint64_t seed, int depth, int& result);
+
+   private:
+    std::vector<Line> search(int depth, TimePoint movetime, int multiPV);
+    bool              label(const Position& pos, int depth, TrainingPosition& p);
+
+    Engine                   engine;
+    std::vector<std::string> moves;
+    std::vector<Line>        lines;
+    std::string              bestMove;
+};
+
+// Searches the game position to 'depth' or for 'movetime' ms, returning the
+// lines that were reported
+std::vector<Line> Worker::search(int depth, TimePoint movetime, int multiPV) {
+    Search::LimitsType limits;
+    limits.startTime = now();
+    limits.depth     = depth;
+    limits.movetime  = movetime;
+
+    std::istringstream is("name MultiPV value " + std::to_string(multiPV));
+    engine.get_options().setoption(is);
+    engine.set_position(StartFEN, moves);
+
+    lines.assign(multiPV, Line());
+    bestMove.clear();
+    engine.go(limits);
+    engine.wait_for_search_finished();
+
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [](const Line& line) { return line.move.empty(); }),
+                lines.end());
+    return lines;
+}
+
+// The searches and labels of analyze_full(). Returns false for positions
+// without legal moves.
+bool Worker::label(const Position& pos, int depth, TrainingPosition& p) {
+    const std::vector<Line> shallow = search(depth / 2, 0, 1);
+    const std::vector<Line> main    = search(depth, 0, MultiPV);
+    const std::vector<Line> deep    = search(depth + 10, 0, 1);
+    if (shallow.empty() || main.empty() || deep.empty())
+        return false;
+
+    const int cp = main[0].cp;
+
+    double rho = 0.0;
+    if (shallow[0].move != main[0].move || main[0].move != deep[0].move)
+        rho = 1.0;
+    else
+    {
+        rho = std::min(std::abs(cp - deep[0].cp) / 200.0, 0.4);
+        if (pos.checkers())
+            rho += 0.25;
+        if (std::abs(cp) < 50)
+            rho += 0.3;
+        if (popcount(pos.pieces()) < 16)
+            rho += 0.2;
+    }
+
+    // Mean score gap between the best line and the alternatives
+    double tau = 0.0;
+    if (main.size() > 1)
+    {
+        double diffs = 0;
+        for (std::size_t i = 1; i < main.size(); ++i)
+            diffs += std::abs(cp - main[i].cp);
+        tau = std::min(diffs / (main.size() - 1) / 100.0, 1.0);
+    }
+
+    const std::vector<Line> multi[] = {main, search(depth + 4, 0, MultiPV),
+                                       search(depth + 8, 0, MultiPV)};
+    for (int i = 0; i < 3; ++i)
+        for (const Line& line : multi[i])
+        {
+            p.bestMoves[i].push_back(line.move);
+            p.bestMoveLabels[i].push_back(move_label(pos, line.move));
+        }
+
+    p.fen        = pos.fen();
+    p.stm        = pos.side_to_move() == WHITE ? 0 : 1;
+    p.evalScore  = cp;
+    p.depth      = depth;
+    p.material   = material(pos);
+    p.pieceCount = popcount(pos.pieces());
+    p.tau        = round4(tau);
+    p.rho        = round4(std::min(rho, 1.0));
+    p.rs         = resolution_score(pos, cp);
+    return true;
+}
+
+std::vector<TrainingPosition> Worker::play(uint64_t seed, int depth, int& result) {
+    PRNG                          rng(seed);
+    std::vector<TrainingPosition> positions;
+
+    StateListPtr states(new std::deque<StateInfo>(1));
+    Position     pos;
+    pos.set(StartFEN, false, &states->back());
+    moves.clear();
+
+    for (int ply = 1; ply <= MaxPlies; ++ply)
+    {
+        if (game_over(pos, *states))
+            break;
+
+        MoveList<LEGAL> legal(pos);
+
+        Move m;
+        if (rng.rand<unsigned>() % 100 < RandomMovePercent)
+            m = legal.begin()[rng.rand<unsigned>() % legal.size()];
+        else
+        {
+            search(0, PlayMoveTime, 1);
+            m = UCIEngine::to_move(pos, bestMove);
+            if (m == Move::none())
+                break;
+        }
+
+        moves.push_back(UCIEngine::move(m, false));
+        states->emplace_back();
+        pos.do_move(m, states->back());
+
+        TrainingPosition p;
+        if (ply > OpeningPlies && label(pos, depth, p))
+            positions.push_back(std::move(p));
+    }
+
+    result = 1;
+    if (!MoveList<LEGAL>(pos).size() && pos.checkers())
+        result = pos.side_to_move() == WHITE ? 0 : 2;
+    return positions;
+}
+
+}  // namespace
+
+void run(Engine& engine, const std::string& binaryPath, std::istream& args) {
+    int         games = 100, threads = 1, depth = 16, hash = 16;
+    std::string outputDir = "data";
+    bool        valid     = true;
+
+    // Missing arguments keep their default values
+    auto read = [&](int& value, int min) {
+        if (valid && !(args >> std::ws).eof())
+            valid = (args >> value) && value >= min;
+    };
+    read(games, 1);
+    read(threads, 1);
+    read(depth, 1);
+    if (!(args >> std::ws).eof())
+        args >> outputDir;
+    read(hash, 1);
+
+    if (!valid)
+    {
+        sync_cout << "info string usage: datagen [games] [threads] [depth] [output directory] "
+                     "[hash]"
+                  << sync_endl;
+        return;
+    }
+
+    // Checked before any game is played, which would otherwise be searched and
+    // labelled in full only to fail when its file is written
+    std::error_code ec;
+    std::filesystem::create_directories(outputDir, ec);
+    if (ec || !std::filesystem::is_directory(outputDir, ec))
+    {
+        sync_cout << "info string datagen: cannot create the output directory " << outputDir
+                  << (ec ? ": " + ec.message() : "") << sync_endl;
+        return;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < threads; ++i)
+        workers.push_back(std::make_unique<Worker>(binaryPath, engine.get_options(), hash));
+
+    const TimePoint  start = now();
+    const uint64_t   stamp = uint64_t(std::time(nullptr));  // names the files of this run
+    std::atomic<int> nextGame{0}, totalPositions{0};
+
+    std::vector<std::thread> pool;
+    for (auto& worker : workers)
+        pool.emplace_back([&, &worker = *worker]() {
+            for (int g; (g = nextGame++) < games;)
+            {
+                int        result;
+                const auto positions =
+                  worker.play(stamp * 6364136223846793005ULL + g + 1, depth, result);
+
+                const std::string file =
+                  outputDir + "/hnn_g" + std::to_string(g) + "_" + std::to_string(stamp) + ".json";
+                std::ofstream out(file);
+                out << "{\"positions\": [";
+                for (std::size_t i = 0; i < positions.size(); ++i)
+                {
+                    out << (i ? ",\n" : "\n");
+                    write_json(out, positions[i], result);
+                }
+                out << "\n]}\n";
+
+                const int       total   = totalPositions += int(positions.size());
+                const TimePoint elapsed = now() - start + 1;
+                if (!out)
+                    sync_cout << "info string datagen: failed to write " << file << sync_endl;
+                else
+                    sync_cout << "info string datagen: game " << g + 1 << "/" << games << ", "
+                              << positions.size() << " positions, " << total << " total, "
+                              << 1000.0 * total / elapsed << " positions/s" << sync_endl;
+            }
+        });
+
+    for (auto& th : pool)
+        th.join();
+
+    sync_cout << "info string datagen: " << totalPositions << " positions from " << games
+              << " games in " << (now() - start) / 1000.0 << " s" << sync_endl;
+}
+
+}  // namespace Stockfish::Datagen
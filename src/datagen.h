@@ -0,0 +1,35 @@
+#ifndef DATAGEN_H_INCLUDED
+#define DATAGEN_H_INCLUDED
+
+#include <iosfwd>
+#include <string>
+
+namespace Stockfish {
+
+class Engine;
+class Score;
+
+namespace Datagen {
+
+// datagen [games] [threads] [depth] [output directory] [hash]
+//
+// Plays 'games' games and labels every position after the opening the way
+// nextfish-harenn/parallel_generate.py does, writing one JSON file of
+// TrainingPosition objects per game into 'output directory', which is created
+// if missing. Games end after 99 plies or where python-chess's is_game_over()
+// ends them: mate, stalemate, insufficient material, the 75-move rule or a
+// fivefold repetition. Each of the
+// 'threads' workers owns a single-threaded engine built from 'binaryPath' with
+// the options of 'engine', so every worker searches its own position with its
+// own hash table and its own copy of the networks.
+void run(Engine& engine, const std::string& binaryPath, std::istream& args);
+
+// The score in centipawns as python-chess gives it to the Python scripts:
+// mates count as +-(10000 - moves), tablebase wins as +-(20000 - plies)
+int to_cp(const Score& s);
+
+}  // namespace Datagen
+
+}  // namespace Stockfish
+
+#endif  // DATAGEN_H_INCLUDED
@@ -2,6 +2,9 @@
 #include "position.h"
 #include "bitboard.h"
 #include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <ostream>
 
 namespace Stockfish {
 namespace DEE {
@@ -12,35 +15,8 @@ namespace DEE {
 Value Evaluator::adjusted_see(const Position& pos, Move m) {
     if (!m) return VALUE_ZERO;
 
-    Square to = m.to_sq();
-    Color us = pos.side_to_move();
-    
-    if (pos.see_ge(m, 50) || !pos.see_ge(m, -50))
-        return VALUE_ZERO;
-
-    Bitboard occupancy = pos.pieces() ^ m.from_sq();
-    Bitboard attackers = pos.attackers_to(to, occupancy);
-    
-    auto get_pressure_score = [&](Color c) {
-        int score = 0;
-        Bitboard b = attackers & pos.pieces(c);
-        while (b) {
-            PieceType pt = type_of(pos.piece_on(pop_lsb(b)));
-            score += (KING - pt); 
-        }
-        return score;
-    };
-
-    int ourP = get_pressure_score(us);
-    int theirP = get_pressure_score(~us);
-    
-    if (ourP > theirP)
-        return Value((ourP - theirP) * 12 + popcount(attackers & pos.pieces(us)) * 4);
-
-    if (theirP > ourP)
-        return Value(-((theirP - ourP) * 10)); // Increased penalty for defender disadvantage
-
-    return VALUE_ZERO;
+    CaptureContext ctx(pos);
+    return ctx.adjusted_see(m);
 }
 
 bool Evaluator::should_prune_in_qs(const Position& pos, Move m, Value adjustedSee) {
@@ -52,7 +28,12 @@ bool Evaluator::should_prune_in_qs(const Position& pos, Move m, Value adjustedSe
     return false;
 }
 
+// Memoized in the StateInfo, so repeated calls at a node cost one load
 int Evaluator::tension_score(const Position& pos) {
+    StateInfo* st = pos.state();
+    if (st->tension >= 0)
+        return st->tension;
+
     Bitboard usAttacks, themAttacks;
     compute_both_attack_maps(pos, usAttacks, themAttacks);
 
@@ -65,26 +46,154 @@ int Evaluator::tension_score(const Position& pos) {
         score += int(PieceValue[pc]) / 100;
     }
 
-    return score;
+    return st->tension = score;
 }
 
 void Evaluator::compute_both_attack_maps(const Position& pos, Bitboard& us, Bitboard& them) {
-    auto compute = [&](Color c) {
-        Bitboard b = pos.attacks_by<PAWN>(c) | pos.attacks_by<KNIGHT>(c) |
-                     pos.attacks_by<KING>(c);
-        
-        Bitboard occ = pos.pieces();
-        Bitboard bishops = pos.pieces(c, BISHOP) | pos.pieces(c, QUEEN);
-        while (bishops) b |= attacks_bb<BISHOP>(pop_lsb(bishops), occ);
-        
-        Bitboard rooks = pos.pieces(c, ROOK) | pos.pieces(c, QUEEN);
-        while (rooks) b |= attacks_bb<ROOK>(pop_lsb(rooks), occ);
-        
-        return b;
+    us = pos.attack_map(pos.side_to_move());
+    them = pos.attack_map(~pos.side_to_move());
+}
+
+CaptureContext::Entry& CaptureContext::entry(Move m) {
+    for (int i = 0; i < size; ++i)
+        if (entries[i].move == m)
+            return entries[i];
+
+    Entry& e = size < MaxEntries ? entries[size++] : overflow;
+    e = {m, -VALUE_INFINITE, VALUE_INFINITE, -1, 0, 0};
+    return e;
+}
+
+Bitboard CaptureContext::attackers_to(Square s) {
+    for (int i = 0; i < targetCount; ++i)
+        if (targets[i] == s)
+            return targetAttackers[i];
+
+    const Bitboard attackers = pos.attackers_to(s);
+    if (targetCount < MaxTargets) {
+        targets[targetCount] = s;
+        targetAttackers[targetCount++] = attackers;
+    }
+    return attackers;
+}
+
+bool CaptureContext::see_ge(Entry& e, int threshold) {
+    if (threshold <= e.seeLow)
+        return true;
+    if (threshold >= e.seeHigh)
+        return false;
+
+    // Thresholds used here are small, so the bounds fit
+    if (pos.see_ge(e.move, threshold)) {
+        e.seeLow = int16_t(threshold);
+        return true;
+    }
+    e.seeHigh = int16_t(threshold);
+    return false;
+}
+
+bool CaptureContext::see_ge(Move m, int threshold) const {
+    for (int i = 0; i < size; ++i)
+        if (entries[i].move == m) {
+            if (threshold <= entries[i].seeLow)
+                return true;
+            if (threshold >= entries[i].seeHigh)
+                return false;
+            break;
+        }
+
+    return pos.see_ge(m, threshold);
+}
+
+// The target's attackers with the moving piece lifted, so that an X-ray
+// behind it counts. Only that X-ray is looked up per move.
+void CaptureContext::compute_pressure(Entry& e) {
+    Square from = e.move.from_sq(), to = e.move.to_sq();
+    Color us = pos.side_to_move();
+
+    Bitboard occupancy = pos.pieces() ^ from;
+    Bitboard attackers = attackers_to(to);
+    if (attacks_bb<BISHOP>(to) & from)
+        attackers |= attacks_bb<BISHOP>(to, occupancy) & pos.pieces(BISHOP, QUEEN);
+    else if (attacks_bb<ROOK>(to) & from)
+        attackers |= attacks_bb<ROOK>(to, occupancy) & pos.pieces(ROOK, QUEEN);
+
+    assert(attackers == pos.attackers_to(to, occupancy));
+
+    auto get_pressure_score = [&](Color c) {
+        int score = 0;
+        Bitboard b = attackers & pos.pieces(c);
+        while (b) {
+            PieceType pt = type_of(pos.piece_on(pop_lsb(b)));
+            score += (KING - pt);
+        }
+        return score;
     };
 
-    us = compute(pos.side_to_move());
-    them = compute(~pos.side_to_move());
+    e.ourPressure = int8_t(get_pressure_score(us));
+    e.theirPressure = int8_t(get_pressure_score(~us));
+    e.ourAttackers = int8_t(popcount(attackers & pos.pieces(us)));
+}
+
+// A bonus or penalty from the attacker pressure on the target square, for
+// captures whose SEE is close to even. The pressure comes first: when it is
+// balanced the result is zero whatever the SEE, and no probe is needed.
+Value CaptureContext::adjusted_see(Move m) {
+    Entry& e = entry(m);
+    if (e.ourPressure < 0)
+        compute_pressure(e);
+
+    if (e.ourPressure == e.theirPressure || see_ge(e, 50) || !see_ge(e, -50))
+        return VALUE_ZERO;
+
+    if (e.ourPressure > e.theirPressure)
+        return Value((e.ourPressure - e.theirPressure) * 12 + e.ourAttackers * 4);
+
+    return Value(-((e.theirPressure - e.ourPressure) * 10)); // Increased penalty for defender disadvantage
+}
+
+// adjusted_see() < -15 needs the opponent ahead by two pressure points, and
+// then a SEE in [-50, 0) decides
+bool CaptureContext::should_prune_in_qs(Move m) {
+    Entry& e = entry(m);
+    if (e.ourPressure < 0)
+        compute_pressure(e);
+
+    return e.theirPressure - e.ourPressure >= 2 && see_ge(e, -50) && !see_ge(e, 0);
+}
+
+void Stats::print(std::ostream& os) const {
+    static const char* Names[PATH_NB] = {"Capture Ordering", "Capture LMR", "Capture Pruning"};
+#ifdef DEE_USE_RDTSC
+    const char* unit = "cycles";
+#else
+    const char* unit = "ns";
+#endif
+
+    os << "\n--- DEE Hooks ---\n"
+       << std::setw(18) << "path" << std::setw(14) << "calls" << std::setw(14) << "positive"
+       << std::setw(14) << "negative" << std::setw(14) << "pruned" << std::setw(16) << unit
+       << std::setw(12) << "per call" << '\n';
+
+    // Only the pruning path prunes, and it has no adjusted_see() sign
+    auto column = [&](uint64_t n, bool used) {
+        os << std::setw(14);
+        if (used)
+            os << n;
+        else
+            os << "-";
+    };
+
+    for (int i = 0; i < PATH_NB; ++i) {
+        const Counters& c = paths[i];
+        os << std::setw(18) << Names[i] << std::setw(14) << c.calls;
+        column(c.positive, i != CapturePruning);
+        column(c.negative, i != CapturePruning);
+        column(c.pruned, i == CapturePruning);
+        os << std::setw(16) << c.ticks
+           << std::setw(12) << std::fixed << std::setprecision(1)
+           << (c.calls ? double(c.ticks) / c.calls : 0.0) << '\n';
+    }
 }
 
 } // namespace DEE
@@ -1,6 +1,18 @@
 #ifndef DEE_H_INCLUDED
 #define DEE_H_INCLUDED
 
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define DEE_USE_RDTSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+    #define DEE_USE_RDTSC
+#endif
+
 #include "types.h"
 #include "position.h"
 
@@ -28,7 +40,7 @@ public:
     // QS Pruning Logic (V15)
     static bool should_prune_in_qs(const Position& pos, Move m, Value adjustedSee);
 
-    // Board-wide tactical metrics
+    // Board-wide tactical metrics, read from or memoized in the StateInfo
     static int tension_score(const Position& pos);
     
     static void
@@ -38,6 +50,113 @@ private:
     static Value evaluate_king_safety(const Position& pos, Color c, Bitboard enemyAttacks);
 };
 
+// Capture analysis of one node, shared by its MovePicker and the search so
+// that scoring, LMR and QS pruning look at each capture once. For every move
+// it keeps the attacker pressure on the target square and the SEE bounds
+// established by the probes so far; the attackers of a target square are
+// found once for all the captures landing there.
+class CaptureContext {
+public:
+    explicit CaptureContext(const Position& p) : pos(p) {}
+
+    // pos.see_ge(m, threshold), answered from the known bounds when they
+    // decide it. Moves not analyzed yet are probed without being cached.
+    bool see_ge(Move m, int threshold) const;
+
+    // Same results as the Evaluator functions
+    Value adjusted_see(Move m);
+    bool  should_prune_in_qs(Move m);
+
+private:
+    static constexpr int MaxEntries = 16;
+    static constexpr int MaxTargets = 8;
+
+    struct Entry {
+        Move    move;
+        int16_t seeLow, seeHigh;  // seeLow <= SEE < seeHigh
+        int8_t  ourPressure, theirPressure, ourAttackers;  // ourPressure -1 until computed
+    };
+
+    Entry&   entry(Move m);
+    bool     see_ge(Entry& e, int threshold);
+    void     compute_pressure(Entry& e);
+    Bitboard attackers_to(Square s);
+
+    // Kept small: a MovePicker lives on the stack of every node
+    const Position& pos;
+    int             targetCount = 0, size = 0;
+    Square          targets[MaxTargets];
+    Bitboard        targetAttackers[MaxTargets];
+    Entry           entries[MaxEntries];
+    Entry           overflow;  // used uncached once 'entries' is full
+};
+
+// Per-thread counters of the DEE hooks in the search, summed over the threads
+// by ThreadPool::dee_stats(). Only kept with the "DEE Stats" option. Costs are
+// in timestamp() ticks.
+struct Stats {
+    enum Path {
+        CaptureOrdering,  // MovePicker bonus for captures, depth >= 6
+        CaptureLMR,       // extra reduction of captures, "Use DEE Capture LMR"
+        CapturePruning,   // qsearch pruning, "Use DEE Capture Pruning"
+        PATH_NB
+    };
+
+    struct Counters {
+        uint64_t calls    = 0;
+        uint64_t positive = 0;  // adjusted_see() > 0
+        uint64_t negative = 0;  // adjusted_see() < 0
+        uint64_t pruned   = 0;
+        uint64_t ticks    = 0;
+    };
+
+    Counters paths[PATH_NB];
+
+    void clear() { *this = {}; }
+
+    Stats& operator+=(const Stats& other) {
+        for (int i = 0; i < PATH_NB; ++i)
+        {
+            paths[i].calls += other.paths[i].calls;
+            paths[i].positive += other.paths[i].positive;
+            paths[i].negative += other.paths[i].negative;
+            paths[i].pruned += other.paths[i].pruned;
+            paths[i].ticks += other.paths[i].ticks;
+        }
+        return *this;
+    }
+
+    // Counts one adjusted_see() call of the given path
+    void add(Path p, Value adjustedSee, uint64_t ticks) {
+        Counters& c = paths[p];
+        c.calls++;
+        c.positive += adjustedSee > 0;
+        c.negative += adjustedSee < 0;
+        c.ticks += ticks;
+    }
+
+    // Counts one should_prune_in_qs() call, which has no adjusted_see() value
+    void add_pruning(bool pruned, uint64_t ticks) {
+        Counters& c = paths[CapturePruning];
+        c.calls++;
+        c.pruned += pruned;
+        c.ticks += ticks;
+    }
+
+    void print(std::ostream& os) const;
+};
+
+// CPU cycles where the timestamp counter can be read, nanoseconds elsewhere
+inline uint64_t timestamp() {
+#ifdef DEE_USE_RDTSC
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count());
+#endif
+}
+
 }  // namespace DEE
 
 }  // namespace Stockfish
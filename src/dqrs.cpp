@@ -1,26 +1,136 @@
 #include "dqrs.h"
 #include "position.h"
-#include <cmath>
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string>
 
 namespace Stockfish {
 namespace DQRS {
 
+Value exchange_value(const Position& pos, Move m, Move* sequence, int* length) {
+    // Only deal with normal moves, as see_ge() does
+    if (m.type_of() != NORMAL) {
+        if (sequence)
+            sequence[0] = m, *length = 1;
+        return VALUE_ZERO;
+    }
+
+    const Square to = m.to_sq();
+    Square from = m.from_sq();
+    Bitboard occupied = pos.pieces() ^ from ^ to;
+    Bitboard attackers = pos.attackers_to(to, occupied);
+    Bitboard stmAttackers, bb;
+    Color stm = pos.side_to_move();
+
+    // gain[d]: result for the side making capture d if the sequence stops
+    // there, best[d]: the same once both sides play on optimally
+    Square capturers[MaxExchangeLength + 1];
+    int gain[MaxExchangeLength + 1], best[MaxExchangeLength + 1], d = 0;
+    int victim = PieceValue[pos.piece_on(from)];  // value now standing on 'to'
+    gain[0] = PieceValue[pos.piece_on(to)];
+    capturers[0] = from;
+
+    while (d < MaxExchangeLength) {
+        stm = ~stm;
+        attackers &= occupied;
+
+        if (!(stmAttackers = attackers & pos.pieces(stm)))
+            break;
+
+        // Pinned pieces may not capture while their pinners are on the board
+        if (pos.pinners(~stm) & occupied) {
+            stmAttackers &= ~pos.blockers_for_king(stm);
+            if (!stmAttackers)
+                break;
+        }
+
+        // The next least valuable attacker, and the X-ray attackers behind it
+        int value;
+        if ((bb = stmAttackers & pos.pieces(PAWN)))
+            value = PawnValue;
+        else if ((bb = stmAttackers & pos.pieces(KNIGHT)))
+            value = KnightValue;
+        else if ((bb = stmAttackers & pos.pieces(BISHOP)))
+            value = BishopValue;
+        else if ((bb = stmAttackers & pos.pieces(ROOK)))
+            value = RookValue;
+        else if ((bb = stmAttackers & pos.pieces(QUEEN)))
+            value = QueenValue;
+        else if (attackers & ~pos.pieces(stm))
+            break;  // the king may not capture a defended piece
+        else
+            bb = stmAttackers, value = VALUE_ZERO;
+
+        from = lsb(bb);
+        occupied ^= from;
+
+        if (value != RookValue && value != KnightValue)
+            attackers |= attacks_bb<BISHOP>(to, occupied) & pos.pieces(BISHOP, QUEEN);
+        if (value == RookValue || value == QueenValue)
+            attackers |= attacks_bb<ROOK>(to, occupied) & pos.pieces(ROOK, QUEEN);
+
+        ++d;
+        gain[d] = victim - gain[d - 1];
+        capturers[d] = from;
+        victim = value;
+
+        if (type_of(pos.piece_on(from)) == KING)
+            break;  // nothing left to recapture with
+    }
+
+    // Each side keeps the better of stopping and capturing on
+    best[d] = gain[d];
+    for (int i = d; i > 0; --i)
+        best[i - 1] = std::min(gain[i - 1], -best[i]);
+
+    assert(pos.see_ge(m, best[0]) && !pos.see_ge(m, best[0] + 1));
+
+    if (sequence) {
+        int n = 1;
+        while (n <= d && best[n] > -gain[n - 1])
+            ++n;
+
+        for (int i = 0; i < n; ++i)
+            sequence[i] = Move(capturers[i], to);
+        *length = n;
+    }
+
+    return Value(best[0]);
+}
+
 ESA_Result analyze_exchange(const Position& pos, Square target) {
-    ESA_Result res = {VALUE_ZERO, true, Move::none()};
+    ESA_Result res = {VALUE_ZERO, true, Move::none(), 0, {}};
+
+    const Color us = pos.side_to_move();
+    const Piece pc = pos.piece_on(target);
+    if (pc == NO_PIECE || color_of(pc) == us || type_of(pc) == KING)
+        return res;
 
-    Value value = VALUE_ZERO;
-    Piece pc    = pos.piece_on(target);
-    if (pc != NO_PIECE)
-        value = PieceValue[pc];
+    Move sequence[MaxExchangeLength];
+    int  length;
 
-    res.optimal_result = value;
+    for (Bitboard b = pos.attackers_to(target) & pos.pieces(us); b;) {
+        const Move m(pop_lsb(b), target);
 
-    Bitboard attackers     = pos.attackers_to(target, pos.pieces());
-    int      attackerCount = popcount(attackers);
-    if (attackerCount >= 3)
-        res.is_stable = false;
+        // Promotions are left to the move generator, like in see_ge()
+        if (type_of(pos.moved_piece(m)) == PAWN && (target & (Rank1BB | Rank8BB)))
+            continue;
+        if (!pos.legal(m))
+            continue;
 
+        const Value v = exchange_value(pos, m, sequence, &length);
+        if (!res.best_move || v > res.optimal_result) {
+            res.optimal_result = v;
+            res.best_move      = m;
+            res.length         = length;
+            std::copy(sequence, sequence + length, res.sequence);
+        }
+    }
+
+    res.is_stable = res.length <= 1;
     return res;
 }
 
@@ -28,8 +138,7 @@ void TrajectoryPredictor::record(int ply, Value v) {
     if (ply >= 0 && ply < MAX_PLY)
     {
         history[ply] = v;
-        if (ply >= count)
-            count = ply + 1;
+        count        = ply + 1;
     }
 }
 
@@ -44,6 +153,10 @@ bool TrajectoryPredictor::should_stop(int ply, Value alpha, Value beta) {
     Value v5 = history[ply - 4];
     Value v6 = history[ply - 5];
 
+    if (ply >= count || v1 == VALUE_NONE || v2 == VALUE_NONE || v3 == VALUE_NONE
+        || v4 == VALUE_NONE || v5 == VALUE_NONE || v6 == VALUE_NONE)
+        return false;
+
     Value d1 = std::abs(v1 - v2);
     Value d2 = std::abs(v2 - v3);
     Value d3 = std::abs(v3 - v4);
@@ -70,5 +183,36 @@ Value TrajectoryPredictor::predicted_convergence() const {
 
 void TrajectoryPredictor::reset() { count = 0; }
 
+void TrajectoryStats::print(std::ostream& os) const {
+    uint64_t totalStops = 0, totalAudited = 0, totalSaved = 0, totalError = 0;
+    int      totalMax   = 0;
+
+    auto row = [&](const std::string& label, uint64_t stop, uint64_t audit, uint64_t saved,
+                   uint64_t error, int maxError) {
+        os << std::setw(6) << label << std::setw(12) << stop << std::setw(12) << audit
+           << std::setw(14) << saved << std::setw(12) << std::fixed << std::setprecision(1)
+           << (audit ? double(saved) / audit : 0.0) << std::setw(12)
+           << (audit ? double(error) / audit : 0.0) << std::setw(10) << maxError << '\n';
+    };
+
+    os << "\n--- DQRS Trajectory Stops ---\n"
+       << std::setw(6) << "ply" << std::setw(12) << "stops" << std::setw(12) << "audited"
+       << std::setw(14) << "nodes saved" << std::setw(12) << "saved/stop" << std::setw(12)
+       << "avg error" << std::setw(10) << "max error" << '\n';
+
+    for (int i = 0; i < MAX_PLY; ++i)
+        if (stops[i])
+        {
+            row(std::to_string(i), stops[i], audited[i], nodesSaved[i], errorSum[i], errorMax[i]);
+            totalStops += stops[i];
+            totalAudited += audited[i];
+            totalSaved += nodesSaved[i];
+            totalError += errorSum[i];
+            totalMax = std::max(totalMax, errorMax[i]);
+        }
+
+    row("total", totalStops, totalAudited, totalSaved, totalError, totalMax);
+}
+
 }  // namespace DQRS
 }  // namespace Stockfish
@@ -1,6 +1,10 @@
 #ifndef DQRS_H_INCLUDED
 #define DQRS_H_INCLUDED
 
+#include <algorithm>
+#include <cstdint>
+#include <iosfwd>
+
 #include "types.h"
 #include "position.h"
 
@@ -8,18 +12,58 @@ namespace Stockfish {
 
 namespace DQRS {
 
+// Longest capture sequence on one square: every piece but the two kings
+// can capture once, then one of the kings
+constexpr int MaxExchangeLength = 32;
+
 struct ESA_Result {
-    Value optimal_result;
-    bool  is_stable;
-    Move  best_move;
+    Value optimal_result;  // for the side to move, VALUE_ZERO if it has no capture
+    bool  is_stable;       // the best capture is not worth recapturing
+    Move  best_move;       // Move::none() if there is no capture
+    int   length;          // of the principal capture sequence
+    Move  sequence[MaxExchangeLength];
 };
 
-// Exchange Sequence Algebra (ESA) - analyzes exchanges on a square
+// Exchange Sequence Algebra (ESA) - solves the capture sequence on 'target'
+// for each capture of the side to move and keeps the best one. Both sides
+// recapture with their least valuable piece, X-ray attackers join as the
+// pieces in front of them leave, and either side stops when continuing
+// would lose more; pins and king captures follow Position::see_ge().
 ESA_Result analyze_exchange(const Position& pos, Square target);
 
-// Eval Trajectory Prediction - tracks eval history in qsearch
+// Outcome of the exchange started by 'm', the exact value behind see_ge():
+// exchange_value(pos, m) >= t if and only if pos.see_ge(m, t). The
+// principal sequence is stored in 'sequence' if given.
+Value exchange_value(const Position& pos, Move m, Move* sequence = nullptr, int* length = nullptr);
+
+// pos.see_ge(m, threshold) for several thresholds of one move. 'value' starts
+// as VALUE_NONE and keeps the exchange value once it had to be solved.
+inline bool exchange_ge(const Position& pos, Move m, int threshold, Value& value) {
+    if (value == VALUE_NONE)
+    {
+        // The value lies between the victim minus the capturer and the victim,
+        // which decides most thresholds without solving anything
+        const int victim = m.type_of() == NORMAL ? int(PieceValue[pos.piece_on(m.to_sq())]) : 0;
+        if (victim < threshold)
+            return false;
+        if (m.type_of() != NORMAL || victim - int(PieceValue[pos.moved_piece(m)]) >= threshold)
+            return true;
+
+        value = exchange_value(pos, m);
+    }
+    return value >= threshold;
+}
+
+// Eval Trajectory Prediction - tracks the static evals along the current
+// line, all from the same side's point of view. When the last six have
+// converged (each step smaller than the one before, the last under 8) the
+// line is expected to settle between the last two, and should_stop() allows
+// qsearch to return that instead of searching on. VALUE_NONE marks a ply
+// without a usable eval, such as one in check, and no trajectory crosses it.
 class TrajectoryPredictor {
    public:
+    // Stores the eval at 'ply' and forgets anything deeper, which belonged
+    // to a line that has been left
     void  record(int ply, Value v);
     bool  should_stop(int ply, Value alpha, Value beta);
     Value predicted_convergence() const;
@@ -30,6 +74,34 @@ class TrajectoryPredictor {
     int   count            = 0;
 };
 
+// Per-ply counters of the trajectory stops taken in qsearch. Nodes saved and
+// the score error are only known for stops that were audited, i.e. followed
+// by the full qsearch the stop replaced.
+struct TrajectoryStats {
+    uint64_t stops[MAX_PLY]      = {};
+    uint64_t audited[MAX_PLY]    = {};
+    uint64_t nodesSaved[MAX_PLY] = {};
+    uint64_t errorSum[MAX_PLY]   = {};  // of |full - predicted|, in internal units
+    int      errorMax[MAX_PLY]   = {};
+
+    void clear() { *this = {}; }
+
+    TrajectoryStats& operator+=(const TrajectoryStats& other) {
+        for (int i = 0; i < MAX_PLY; ++i)
+        {
+            stops[i] += other.stops[i];
+            audited[i] += other.audited[i];
+            nodesSaved[i] += other.nodesSaved[i];
+            errorSum[i] += other.errorSum[i];
+            errorMax[i] = std::max(errorMax[i], other.errorMax[i]);
+        }
+        return *this;
+    }
+
+    // One row per ply with a stop, then the totals
+    void print(std::ostream& os) const;
+};
+
 }  // namespace DQRS
 
 }  // namespace Stockfish
@@ -30,6 +30,7 @@
 #include <utility>
 #include <vector>
 
+#include "benchmark.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "nnue/network.h"
@@ -60,6 +61,46 @@ int            MaxThreads = std::max(1024, 4 * int(get_hardware_concurrency()));
 // PR#6526). The user can always explicitly override this behavior.
 constexpr NumaAutoPolicy DefaultNumaPolicy = BundledL3Policy{32};
 
+namespace {
+
+// Set on the thread of an analyze() run, see wait_for_analysis()
+thread_local bool onAnalysisThread = false;
+
+// Standard chess positions of the default bench, with any trailing moves played
+std::vector<std::string> bench_fens() {
+    std::istringstream       args("16 1 1 default");
+    std::vector<std::string> fens;
+    bool                     chess960 = false;
+
+    for (const std::string& cmd : Benchmark::setup_bench(StartFEN, args))
+    {
+        if (cmd.find("UCI_Chess960") != std::string::npos)
+            chess960 = cmd.find("true") != std::string::npos;
+
+        if (chess960 || cmd.rfind("position fen ", 0) != 0)
+            continue;
+
+        std::istringstream is(cmd.substr(13));
+        std::string        fen, token;
+        while (is >> token && token != "moves")
+            fen += (fen.empty() ? "" : " ") + token;
+
+        StateListPtr st(new std::deque<StateInfo>(1));
+        Position     p;
+        p.set(fen, false, &st->back());
+        while (is >> token)
+        {
+            st->emplace_back();
+            p.do_move(UCIEngine::to_move(p, token), st->back());
+        }
+        fens.push_back(p.fen());
+    }
+
+    return fens;
+}
+
+}  // namespace
+
 Engine::Engine(std::optional<std::string> path) :
     binaryDirectory(path ? CommandLine::get_binary_directory(*path) : ""),
     numaContext(NumaConfig::from_system(DefaultNumaPolicy)),
@@ -68,7 +109,8 @@ Engine::Engine(std::optional<std::string> path) :
     networks(numaContext,
              // Heap-allocate because sizeof(NN::Networks) is large
              std::make_unique<NN::Networks>(NN::EvalFile{EvalFileDefaultNameBig, "None", ""},
-                                            NN::EvalFile{EvalFileDefaultNameSmall, "None", ""})) {
+                                            NN::EvalFile{EvalFileDefaultNameSmall, "None", ""})),
+    harenn(numaContext) {
     pos.set(StartFEN, false, &states->back());
 
     options.add(  //
@@ -96,6 +138,21 @@ Engine::Engine(std::optional<std::string> path) :
           return std::nullopt;
       }));
 
+    options.add(  //
+      "TT Stats", Option(false, [this](const Option& o) {
+          wait_for_search_finished();
+          tt.sample_keys(o);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "TT Placement",
+      Option("FirstTouch var FirstTouch var Interleave var Striped", "FirstTouch",
+             [this](const Option&) {
+                 set_tt_size(options["Hash"]);
+                 return std::nullopt;
+             }));
+
     options.add(  //
       "Clear Hash", Option([this](const Option&) {
           search_clear();
@@ -148,10 +205,20 @@ Engine::Engine(std::optional<std::string> path) :
           return std::nullopt;
       }));
 
+    options.add(  //
+      "HARENN File", Option(HarennFileDefaultName, [this](const Option& o) {
+          load_harenn_network(o);
+          return std::nullopt;
+      }));
+
     options.add("Use DEE/HARENN", Option(true));
     options.add("Use DEE Capture Ordering", Option(true));
     options.add("Use DEE Capture Pruning", Option(false));
     options.add("Use DEE Capture LMR", Option(false));
+    options.add("DEE Stats", Option(false));
+    options.add("Use DQRS Exchange Solver", Option(false));
+    options.add("Use DQRS Trajectory Stop", Option(false));
+    options.add("DQRS Trajectory Audit", Option(false));
     options.add("Use HARE Aspiration", Option(true));
     options.add("Use HARE Reduction", Option(true));
     options.add("Use HARE FailLow Verify", Option(true));
@@ -162,9 +229,8 @@ Engine::Engine(std::optional<std::string> path) :
     options.add("HARE TM Range Max", Option(105, 100, 115));   // integer %
     options.add("HARE Ext Threshold White", Option(823, 500, 950));  // thousandths: 823 = 0.823
     options.add("HARE Ext Threshold Black", Option(706, 500, 950));  // thousandths: 706 = 0.706
-    
-    // Initialize HARENN controller
-    HARENN::Controller::init();
+
+    load_harenn_network(options["HARENN File"]);
     
     load_networks();
     resize_threads();
@@ -178,11 +244,40 @@ std::uint64_t Engine::perft(const std::string& fen, Depth depth, bool isChess960
 
 void Engine::go(Search::LimitsType& limits) {
     assert(limits.perft == 0);
+    wait_for_search_finished();
     verify_networks();
+    tt.wait_for_zeroing();
 
     threads.start_thinking(options, pos, states, limits);
 }
-void Engine::stop() { threads.stop = true; }
+
+void Engine::analyze(std::vector<std::string>                    fens,
+                     const Search::LimitsType&                   limits,
+                     std::function<void(Search::AnalysisResult)> onResult,
+                     std::function<void()>                       onDone) {
+    wait_for_search_finished();
+    verify_networks();
+    tt.wait_for_zeroing();
+
+    // Cleared here rather than on the new thread, so that a stop() sent right
+    // after this returns is not lost
+    threads.stop = threads.abortedSearch = false;
+    threads.increaseDepth                = true;
+
+    tt.new_search();
+    analysisThread = std::make_unique<NativeThread>(
+      [this, fens = std::move(fens), limits, onResult = std::move(onResult),
+       onDone = std::move(onDone)]() {
+          onAnalysisThread = true;
+          threads.analyze(fens, limits, onResult);
+          onDone();
+      });
+}
+
+void Engine::stop() {
+    threads.stop = true;
+    threads.notify_stop_signal();
+}
 
 void Engine::search_clear() {
     wait_for_search_finished();
@@ -214,7 +309,23 @@ void Engine::set_on_verify_networks(std::function<void(std::string_view)>&& f) {
     onVerifyNetworks = std::move(f);
 }
 
-void Engine::wait_for_search_finished() { threads.main_thread()->wait_for_search_finished(); }
+// Also waits for the other jobs of the threads, such as zeroing a resized TT
+void Engine::wait_for_search_finished() {
+    wait_for_analysis();
+    threads.main_thread()->wait_for_search_finished();
+    threads.wait_for_search_finished();
+}
+
+// The run restores the Threads option itself, which must not wait for the run
+void Engine::wait_for_analysis() {
+    if (analysisThread && !onAnalysisThread)
+    {
+        analysisThread->join();
+        analysisThread.reset();
+    }
+}
+
+void Engine::wait_for_tt() { tt.wait_for_zeroing(); }
 
 void Engine::set_position(const std::string& fen, const std::vector<std::string>& moves) {
     // Drop the old state and create a new one
@@ -260,8 +371,9 @@ void Engine::set_numa_config_from_option(const std::string& o) {
 }
 
 void Engine::resize_threads() {
+    wait_for_analysis();
     threads.wait_for_search_finished();
-    threads.set(numaContext.get_numa_config(), {options, threads, tt, sharedHists, networks},
+    threads.set(numaContext.get_numa_config(), {options, threads, tt, sharedHists, networks, harenn},
                 updateContext);
 
     // Reallocate the hash with the new threadpool size
@@ -270,11 +382,34 @@ void Engine::resize_threads() {
 }
 
 void Engine::set_tt_size(size_t mb) {
+    const Option& placement = options["TT Placement"];
+
     wait_for_search_finished();
-    tt.resize(mb, threads);
+    tt.resize(mb, threads,
+              placement == "Interleave" ? TranspositionTable::Interleave
+              : placement == "Striped"  ? TranspositionTable::Striped
+                                        : TranspositionTable::FirstTouch);
 }
 
-void Engine::set_ponderhit(bool b) { threads.main_manager()->ponder = b; }
+std::string Engine::save_tt(const std::string& file) {
+    wait_for_search_finished();
+    return tt.save(file);
+}
+
+std::string Engine::load_tt(const std::string& file) {
+    wait_for_search_finished();
+    return tt.load(file);
+}
+
+double Engine::tt_probe_latency(size_t probes) {
+    wait_for_search_finished();
+    return tt.probe_latency(threads, probes);
+}
+
+void Engine::set_ponderhit(bool b) {
+    threads.main_manager()->ponder = b;
+    threads.notify_stop_signal();
+}
 
 // network related
 
@@ -336,6 +471,12 @@ void Engine::load_small_network(const std::string& file) {
     threads.ensure_network_replicated();
 }
 
+void Engine::load_harenn_network(const std::string& file) {
+    harenn.load(binaryDirectory, file);
+    threads.clear();
+    threads.ensure_network_replicated();
+}
+
 void Engine::save_network(const std::pair<std::optional<std::string>, std::string> files[2]) {
     networks.modify_and_replicate([&files](NN::Networks& networks_) {
         networks_.big.save(files[0].first);
@@ -357,15 +498,56 @@ void Engine::trace_eval() const {
 
 void Engine::trace_harenn() const {
     verify_networks();
-    HARENN::EvalResult res = HARENN::GuidanceProvider::query(pos, NumaReplicatedAccessToken(0));
+    HARENN::EvalResult res = harenn.query(pos, NumaReplicatedAccessToken(0));
     sync_cout << "\n--- HARENN Model Inference ---"
               << "\nEvaluation: " << (res.eval * 100.0f) << " cp"
               << "\nTactical Complexity (Tau): " << res.tau
               << "\nHorizon Risk (Rho): " << res.rho
-              << "\nResolution Score (RS): " << res.rs
+              << "\nResolution Score (RS): " << res.rs;
+
+    const auto [hits, misses] = threads.harenn_cache_stats();
+    const uint64_t probes     = hits + misses;
+    std::cout << "\n\n--- HARENN Search Cache ---"
+              << "\nHits: " << hits
+              << "\nMisses: " << misses
+              << "\nHit rate: " << (probes ? 100.0 * hits / probes : 0.0) << " %";
+
+    const HARENN::ExtensionStats ext   = threads.harenn_extension_stats();
+    const uint64_t               calls = ext.queried + ext.skipped;
+    std::cout << "\n\n--- HARENN Search Extension ---"
+              << "\nCalls: " << calls
+              << "\nSkipped before query: " << ext.skipped
+              << "\nQueried: " << ext.queried
+              << "\nExtended: " << ext.extended
+              << " (" << (ext.queried ? 100.0 * ext.extended / ext.queried : 0.0) << " % of queries)"
               << sync_endl;
 }
 
+DQRS::TrajectoryStats Engine::trajectory_stats() const { return threads.trajectory_stats(); }
+
+DEE::Stats Engine::dee_stats() const { return threads.dee_stats(); }
+
+TTStats Engine::tt_stats() const {
+    TTStats stats = threads.tt_stats();
+    tt.occupancy(stats);
+    return stats;
+}
+
+std::string Engine::bench_harenn_heads(int iterations) const {
+    return harenn.benchmark(pos, iterations);
+}
+
+std::string Engine::bench_harenn(int positions, int iterations) const {
+    std::vector<std::string> fens = bench_fens();
+    if (positions > 0 && positions < int(fens.size()))
+        fens.resize(positions);
+    return harenn.bench(fens, iterations);
+}
+
+std::string Engine::quantize_harenn(const std::string& file) const {
+    return harenn.quantize(file, bench_fens());
+}
+
 const OptionsMap& Engine::get_options() const { return options; }
 OptionsMap&       Engine::get_options() { return options; }
 
@@ -381,6 +563,10 @@ std::string Engine::visualize() const {
 
 int Engine::get_hashfull(int maxAge) const { return tt.hashfull(maxAge); }
 
+double Engine::get_tt_false_hit_rate() const { return tt.false_hit_rate(); }
+
+std::string Engine::get_tt_layout() const { return TranspositionTable::layout(); }
+
 std::vector<std::pair<size_t, size_t>> Engine::get_bound_thread_count_by_numa_node() const {
     auto                                   counts = threads.get_bound_thread_count_by_numa_node();
     const NumaConfig&                      cfg    = numaContext.get_numa_config();
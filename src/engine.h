@@ -23,12 +23,14 @@
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
 
+#include "harenn.h"
 #include "history.h"
 #include "nnue/network.h"
 #include "numa.h"
@@ -63,9 +65,18 @@ class Engine {
     void go(Search::LimitsType&);
     // non blocking call to stop searching
     void stop();
-
-    // blocking call to wait for search to finish
+    // non blocking call that searches many positions at once, see ThreadPool::analyze().
+    // The run has a thread of its own, which calls 'onDone' when every position
+    // is searched or stop() ended the run.
+    void analyze(std::vector<std::string>                    fens,
+                 const Search::LimitsType&                   limits,
+                 std::function<void(Search::AnalysisResult)> onResult,
+                 std::function<void()>                       onDone);
+
+    // blocking call to wait for search, or an analyze() run, to finish
     void wait_for_search_finished();
+    // blocks until a resized TT is zeroed, which the next search needs
+    void wait_for_tt();
     // set a new position, moves are in UCI format
     void set_position(const std::string& fen, const std::vector<std::string>& moves);
 
@@ -74,6 +85,10 @@ class Engine {
     void set_numa_config_from_option(const std::string& o);
     void resize_threads();
     void set_tt_size(size_t mb);
+    // TT snapshots, see TranspositionTable::save(); an error message or empty
+    std::string save_tt(const std::string& file);
+    std::string load_tt(const std::string& file);
+    double      tt_probe_latency(size_t probes);
     void set_ponderhit(bool);
     void search_clear();
 
@@ -89,17 +104,29 @@ class Engine {
     void load_networks();
     void load_big_network(const std::string& file);
     void load_small_network(const std::string& file);
+    void load_harenn_network(const std::string& file);
     void save_network(const std::pair<std::optional<std::string>, std::string> files[2]);
 
     // utility functions
 
-    void trace_eval() const;
-    void trace_harenn() const;
+    void        trace_eval() const;
+    void        trace_harenn() const;
+    std::string bench_harenn_heads(int iterations) const;
+    std::string bench_harenn(int positions, int iterations) const;
+    std::string quantize_harenn(const std::string& file) const;
+    // Counters of the DQRS trajectory stops and the DEE hooks since the last ucinewgame
+    DQRS::TrajectoryStats trajectory_stats() const;
+    DEE::Stats            dee_stats() const;
+    // The TT counters of all threads since the last ucinewgame, with the
+    // occupancy of the table now
+    TTStats tt_stats() const;
 
     const OptionsMap& get_options() const;
     OptionsMap&       get_options();
 
-    int get_hashfull(int maxAge = 0) const;
+    int         get_hashfull(int maxAge = 0) const;
+    double      get_tt_false_hit_rate() const;
+    std::string get_tt_layout() const;
 
     std::string                            fen() const;
     void                                   flip();
@@ -111,6 +138,8 @@ class Engine {
     std::string                            thread_binding_information_as_string() const;
 
    private:
+    void wait_for_analysis();
+
     const std::string binaryDirectory;
 
     NumaReplicationContext numaContext;
@@ -122,10 +151,12 @@ class Engine {
     ThreadPool                                         threads;
     TranspositionTable                                 tt;
     LazyNumaReplicatedSystemWide<Eval::NNUE::Networks> networks;
+    HARENN::GuidanceProvider                           harenn;
 
     Search::SearchManager::UpdateContext  updateContext;
     std::function<void(std::string_view)> onVerifyNetworks;
     std::map<NumaIndex, SharedHistories>  sharedHists;
+    std::unique_ptr<NativeThread>         analysisThread;
 };
 
 }  // namespace Stockfish
@@ -2,15 +2,47 @@
 #include "position.h"
 #include "bitboard.h"
 #include "dee.h"
+#include "movegen.h"
 #include "numa.h"
+#include "nnue/simd.h"
 #include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <chrono>
 #include <cmath>
+#include <sstream>
 #include <vector>
-#include <immintrin.h>
 #include <functional>
 
+#define INCBIN_SILENCE_BITCODE_WARNING
+#include "incbin/incbin.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+        #define NOMINMAX  // Disable macros min() and max()
+    #endif
+    #include <windows.h>
+#endif
+
+// The default model is embedded in the binary like the NNUE networks, unless
+// embedding is turned off, in which case it is read from disk.
+#if !defined(_MSC_VER) && !defined(NNUE_EMBEDDING_OFF)
+INCBIN(EmbeddedHarenn, HarennFileDefaultName);
+#else
+const unsigned char        gEmbeddedHarennData[1] = {0x0};
+const unsigned char* const gEmbeddedHarennEnd     = &gEmbeddedHarennData[1];
+const unsigned int         gEmbeddedHarennSize    = 1;
+#endif
+
 namespace Stockfish {
 
 namespace HARENN {
@@ -39,310 +71,1238 @@ namespace {
     }
 }
 
-bool Network::load(const std::string& filename) {
-    std::ifstream f(filename, std::ios::binary | std::ios::ate);
-    if (!f) return false;
+bool Network::load(const char* data, std::size_t size) {
+    if (size < 12) return false; // Magic (4) + eval_mean (4) + eval_std (4)
 
-    std::streamsize file_size = f.tellg();
-    if (file_size < 12) return false; // Magic (4) + eval_mean (4) + eval_std (4)
-    
-    f.seekg(0, std::ios::beg);
-    
-    std::vector<char> buffer(file_size);
-    if (!f.read(buffer.data(), file_size)) return false;
-    f.close();
-    
-    const char* ptr = buffer.data();
-    const char* end = ptr + file_size;
+    const char* ptr = data;
+    const char* end = data + size;
     
     // Parse magic
-    if (std::string(ptr, 4) != "HNN4") return false;
+    const std::string magic(ptr, 4);
+    if (magic != "HNN4" && magic != "HNN5") return false;
+    quantized = magic == "HNN5";
     ptr += 4;
     
     // Parse mean and std
     std::memcpy(&eval_mean, ptr, 4); ptr += 4;
     std::memcpy(&eval_std, ptr, 4); ptr += 4;
     
-    auto load_layer = [&](Layer& layer, bool bias_size_is_cols) {
+    // HNN5 layers carry a scale after the shape and int8 weights, which are
+    // passed to 'store' one at a time with their row-major index
+    auto load_layer = [&](auto& layer, bool bias_size_is_cols, float* scale, auto&& store) {
         if (end - ptr < 8) return false;
         std::memcpy(&layer.rows, ptr, 4); ptr += 4;
         std::memcpy(&layer.cols, ptr, 4); ptr += 4;
         
-        int size = layer.rows * layer.cols;
-        int bias_size = bias_size_is_cols ? layer.cols : layer.rows;
+        if (layer.rows < 0 || layer.cols < 0) return false;
+        int64_t weight_size = int64_t(layer.rows) * layer.cols;
+        int64_t bias_size = bias_size_is_cols ? layer.cols : layer.rows;
+        int64_t weight_bytes = scale ? weight_size : weight_size * 2;
         
-        if (size < 0 || bias_size < 0 || end - ptr < size * 2 + bias_size * 4) return false;
+        if (end - ptr < (scale ? 4 : 0) + weight_bytes + bias_size * 4) return false;
         
-        layer.weights.reserve(size);
-        layer.weights.resize(size);
-        std::memcpy(layer.weights.data(), ptr, size * 2); ptr += size * 2;
+        // The layer storage is fixed-size, so reject shapes it cannot hold
+        if (weight_size > int64_t(layer.weights.size()) || bias_size > int64_t(layer.bias.size())) return false;
         
-        layer.bias.reserve(bias_size);
-        layer.bias.resize(bias_size);
+        if (scale) {
+            std::memcpy(scale, ptr, 4); ptr += 4;
+            for (int64_t i = 0; i < weight_size; ++i)
+                store(i, int8_t(ptr[i]));
+        } else
+            std::memcpy(layer.weights.data(), ptr, weight_bytes);
+        ptr += weight_bytes;
         std::memcpy(layer.bias.data(), ptr, bias_size * 4); ptr += bias_size * 4;
         return true;
     };
     
-    if (!load_layer(fc1, true)) return false;
-    if (!load_layer(fc2, false)) return false;
-    if (!load_layer(eval_head, false)) return false;
-    if (!load_layer(tau_head, false)) return false;
-    if (!load_layer(rho_head, false)) return false;
-    if (!load_layer(rs_head, false)) return false;
+    auto load_fc2 = [&](int64_t i, int8_t w) {
+        // Row-major (output, input) to groups of 4 inputs for all outputs
+        const int64_t o = i / fc2.cols, in = i % fc2.cols;
+        // -128 could saturate the int16 pair sums of maddubs; save_quantized()
+        // never writes it
+        fc2_weights8[(in / 4 * fc2.rows + o) * 4 + in % 4] = std::max<int8_t>(w, -127);
+    };
+    
+    auto int16_only = [](int64_t, int8_t) {};
+
+    fc2_scale = 1.0f;
+    std::fill(std::begin(heads_scale), std::end(heads_scale), 1.0f);
     
+    if (!load_layer(fc1, true, nullptr, int16_only)) return false;
+    if (quantized) {
+        // The scrambled fc2 order depends on the shape, so check it first
+        if (end - ptr < 8) return false;
+        int rows, cols;
+        std::memcpy(&rows, ptr, 4);
+        std::memcpy(&cols, ptr + 4, 4);
+        if (rows < 0 || rows > MaxL2Size || rows % 16 || cols < 0 || cols > MaxL1Size || cols % 4)
+            return false;
+        if (!load_layer(fc2, false, &fc2_scale, load_fc2)) return false;
+    } else if (!load_layer(fc2, false, nullptr, int16_only)) return false;
+    
+    OutputLayer* outputs[HeadCount] = {&eval_head, &tau_head, &rho_head, &rs_head};
+    for (int k = 0; k < HeadCount; ++k) {
+        OutputLayer& head = *outputs[k];
+        auto load_head = [&](int64_t i, int8_t w) { head.weights[i] = w; };
+        if (!load_layer(head, false, quantized ? &heads_scale[k] : nullptr, load_head)) return false;
+    }
+
+    // The inference buffers are fixed-size, so reject shapes they cannot hold
+    if (fc1.rows != FeatureCount || fc1.cols > MaxL1Size) return false;
+    if (fc2.cols != fc1.cols || fc2.rows > MaxL2Size) return false;
+    for (const OutputLayer* head : outputs)
+        if (head->rows != 1 || head->cols != fc2.rows) return false;
+
+    pack_heads();
     return true;
 }
 
 namespace {
-    // Shared hidden layer computation for lazy evaluation (2-layer architecture)
-    void compute_hidden_layer(const int* active_features, int count, 
-                              const Layer& fc1, const Layer& fc2,
-                              int32_t* h1, int32_t* h2) {
+    // Symmetric per-layer int8 quantization: the largest weight maps to 127
+    float quantize_weights(const int16_t* w, int64_t count, std::vector<int8_t>& out) {
+        int maxAbs = 0;
+        for (int64_t i = 0; i < count; ++i)
+            maxAbs = std::max(maxAbs, std::abs(int(w[i])));
+
+        const float scale = maxAbs ? maxAbs / 127.0f : 1.0f;
+        out.resize(count);
+        for (int64_t i = 0; i < count; ++i)
+            out[i] = int8_t(std::clamp(int(std::lround(w[i] / scale)), -127, 127));
+        return scale;
+    }
+}
+
+bool Network::save_quantized(std::ostream& stream) const {
+    if (quantized) return false;
+
+    auto write = [&](const void* p, std::size_t n) { stream.write(static_cast<const char*>(p), n); };
+
+    auto write_int8 = [&](const auto& layer, int64_t bias_size) {
+        std::vector<int8_t> w8;
+        const float scale = quantize_weights(layer.weights.data(), int64_t(layer.rows) * layer.cols, w8);
+        write(&layer.rows, 4);
+        write(&layer.cols, 4);
+        write(&scale, 4);
+        write(w8.data(), w8.size());
+        write(layer.bias.data(), bias_size * 4);
+    };
+
+    write("HNN5", 4);
+    write(&eval_mean, 4);
+    write(&eval_std, 4);
+
+    write(&fc1.rows, 4);
+    write(&fc1.cols, 4);
+    write(fc1.weights.data(), int64_t(fc1.rows) * fc1.cols * 2);
+    write(fc1.bias.data(), fc1.cols * 4);
+
+    write_int8(fc2, fc2.rows);
+    for (const OutputLayer* head : {&eval_head, &tau_head, &rho_head, &rs_head})
+        write_int8(*head, 1);
+
+    return !stream.fail();
+}
+
+void Network::pack_heads() {
+    const OutputLayer* layers[HeadCount] = {&eval_head, &tau_head, &rho_head, &rs_head};
+    const int out_features2 = fc2.rows;
+
+    // Chunks of HeadChunk inputs hold the four head rows back to back: eval,
+    // tau, rho, rs. Any remaining inputs are interleaved per input at the end.
+    const int chunks = out_features2 / HeadChunk;
+    for (int c = 0; c < chunks; ++c)
+        for (int k = 0; k < HeadCount; ++k)
+            for (int j = 0; j < HeadChunk; ++j)
+                heads[(c * HeadCount + k) * HeadChunk + j] = layers[k]->weights[c * HeadChunk + j];
+
+    for (int j = chunks * HeadChunk; j < out_features2; ++j)
+        for (int k = 0; k < HeadCount; ++k)
+            heads[j * HeadCount + k] = layers[k]->weights[j];
+
+    for (int k = 0; k < HeadCount; ++k)
+        heads_bias[k] = layers[k]->bias[0];
+}
+
+namespace {
+    // Integer kernels on top of the NNUE SIMD layer. hvec32_t holds int32 lanes,
+    // hvec16_t int16 lanes of the same register; the products of hvec_dot_16 are
+    // summed pairwise into int32 lanes like _mm_madd_epi16. Without SSE4.1 or
+    // NEON the scalar loops that handle the remainders do all the work.
+#if defined(USE_AVX512)
+    using hvec32_t = __m512i;
+    using hvec16_t = __m512i;
+    #define HARENN_VECTOR
+    #define hvec_zero() _mm512_setzero_si512()
+    #define hvec_set_16(a) _mm512_set1_epi16(a)
+    #define hvec_load_32(a) _mm512_loadu_si512(a)
+    #define hvec_store_32(a, b) _mm512_storeu_si512(a, b)
+    #define hvec_load_16(a) _mm512_loadu_si512(a)
+    #define hvec_store_16(a, b) _mm512_storeu_si512(a, b)
+    // The masked forms avoid an undefined source operand that GCC 12 flags
+    // as uninitialized once inlined through LTO
+    #define hvec_load_16_32(a) _mm512_maskz_cvtepi16_epi32(0xFFFF, _mm256_loadu_si256((const __m256i*)(a)))
+    #define hvec_add_32(a, b) _mm512_add_epi32(a, b)
+    #define hvec_sub_32(a, b) _mm512_sub_epi32(a, b)
+    #define hvec_max_16(a, b) _mm512_max_epi16(a, b)
+    #define hvec_min_16(a, b) _mm512_min_epi16(a, b)
+    // packs works per 128-bit lane, the permute restores the input order
+    #define hvec_pack_32_16(a, b) \
+        _mm512_maskz_permutexvar_epi64(0xFF, _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7), \
+                                       _mm512_packs_epi32(a, b))
+    #if defined(USE_VNNI)
+        #define hvec_dot_16(acc, a, b) _mm512_dpwssd_epi32(acc, a, b)
+    #else
+        #define hvec_dot_16(acc, a, b) _mm512_add_epi32(acc, _mm512_madd_epi16(a, b))
+    #endif
+    #define hvec_hadd_32(a) \
+        Eval::NNUE::SIMD::m256_hadd(_mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xF, a, 0), \
+                                                      _mm512_maskz_extracti64x4_epi64(0xF, a, 1)), 0)
+
+#elif defined(USE_AVX2)
+    using hvec32_t = __m256i;
+    using hvec16_t = __m256i;
+    #define HARENN_VECTOR
+    #define hvec_zero() _mm256_setzero_si256()
+    #define hvec_set_16(a) _mm256_set1_epi16(a)
+    #define hvec_load_32(a) _mm256_loadu_si256((const __m256i*)(a))
+    #define hvec_store_32(a, b) _mm256_storeu_si256((__m256i*)(a), b)
+    #define hvec_load_16(a) _mm256_loadu_si256((const __m256i*)(a))
+    #define hvec_store_16(a, b) _mm256_storeu_si256((__m256i*)(a), b)
+    #define hvec_load_16_32(a) _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(a)))
+    #define hvec_add_32(a, b) _mm256_add_epi32(a, b)
+    #define hvec_sub_32(a, b) _mm256_sub_epi32(a, b)
+    #define hvec_max_16(a, b) _mm256_max_epi16(a, b)
+    #define hvec_min_16(a, b) _mm256_min_epi16(a, b)
+    // packs works per 128-bit lane, the permute restores the input order
+    #define hvec_pack_32_16(a, b) _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8)
+    #if defined(USE_VNNI)
+        #define hvec_dot_16(acc, a, b) _mm256_dpwssd_epi32(acc, a, b)
+    #else
+        #define hvec_dot_16(acc, a, b) _mm256_add_epi32(acc, _mm256_madd_epi16(a, b))
+    #endif
+    #define hvec_hadd_32(a) Eval::NNUE::SIMD::m256_hadd(a, 0)
+
+#elif defined(USE_SSE41)
+    using hvec32_t = __m128i;
+    using hvec16_t = __m128i;
+    #define HARENN_VECTOR
+    #define hvec_zero() _mm_setzero_si128()
+    #define hvec_set_16(a) _mm_set1_epi16(a)
+    #define hvec_load_32(a) _mm_loadu_si128((const __m128i*)(a))
+    #define hvec_store_32(a, b) _mm_storeu_si128((__m128i*)(a), b)
+    #define hvec_load_16(a) _mm_loadu_si128((const __m128i*)(a))
+    #define hvec_store_16(a, b) _mm_storeu_si128((__m128i*)(a), b)
+    #define hvec_load_16_32(a) _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(a)))
+    #define hvec_add_32(a, b) _mm_add_epi32(a, b)
+    #define hvec_sub_32(a, b) _mm_sub_epi32(a, b)
+    #define hvec_max_16(a, b) _mm_max_epi16(a, b)
+    #define hvec_min_16(a, b) _mm_min_epi16(a, b)
+    #define hvec_pack_32_16(a, b) _mm_packs_epi32(a, b)
+    #define hvec_dot_16(acc, a, b) _mm_add_epi32(acc, _mm_madd_epi16(a, b))
+    #define hvec_hadd_32(a) Eval::NNUE::SIMD::m128_hadd(a, 0)
+
+#elif defined(USE_NEON)
+    using hvec32_t = int32x4_t;
+    using hvec16_t = int16x8_t;
+    #define HARENN_VECTOR
+    #define hvec_zero() vdupq_n_s32(0)
+    #define hvec_set_16(a) vdupq_n_s16(a)
+    #define hvec_load_32(a) vld1q_s32(a)
+    #define hvec_store_32(a, b) vst1q_s32(a, b)
+    #define hvec_load_16(a) vld1q_s16(a)
+    #define hvec_store_16(a, b) vst1q_s16(a, b)
+    #define hvec_load_16_32(a) vmovl_s16(vld1_s16(a))
+    #define hvec_add_32(a, b) vaddq_s32(a, b)
+    #define hvec_sub_32(a, b) vsubq_s32(a, b)
+    #define hvec_max_16(a, b) vmaxq_s16(a, b)
+    #define hvec_min_16(a, b) vminq_s16(a, b)
+    #define hvec_pack_32_16(a, b) vcombine_s16(vqmovn_s32(a), vqmovn_s32(b))
+    #define hvec_dot_16(acc, a, b) \
+        vmlal_s16(vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b)), vget_high_s16(a), vget_high_s16(b))
+    #define hvec_hadd_32(a) Eval::NNUE::SIMD::neon_m128_reduce_add_epi32(a)
+#endif
+
+#ifdef HARENN_VECTOR
+    constexpr int Lanes32 = sizeof(hvec32_t) / sizeof(int32_t);
+    constexpr int Lanes16 = sizeof(hvec16_t) / sizeof(int16_t);
+    static_assert(Lanes16 == 2 * Lanes32);
+
+    // Sums the int32 lanes in 64 bits, for outputs that may exceed the int32 range
+    int64_t hvec_hadd_64(hvec32_t v) {
+        int32_t lanes[Lanes32];
+        hvec_store_32(lanes, v);
+        int64_t sum = 0;
+        for (int l = 0; l < Lanes32; ++l)
+            sum += lanes[l];
+        return sum;
+    }
+#endif
+
+    // Writes 'from' (zero if null) plus the added fc1 rows minus the removed
+    // rows into 'to'. Each chunk is held in a register while all rows are applied.
+    void apply_rows(const InputLayer& fc1, const int32_t* from, int32_t* to,
+                    const int* added, int addCount, const int* removed, int removeCount) {
+        const int out_features1 = fc1.cols;
+        const int16_t* w = fc1.weights.data();
+
+        int j = 0;
+#ifdef HARENN_VECTOR
+        for (; j <= out_features1 - Lanes32; j += Lanes32) {
+            hvec32_t acc = from ? hvec_load_32(from + j) : hvec_zero();
+            for (int k = 0; k < removeCount; ++k)
+                acc = hvec_sub_32(acc, hvec_load_16_32(w + removed[k] * out_features1 + j));
+            for (int k = 0; k < addCount; ++k)
+                acc = hvec_add_32(acc, hvec_load_16_32(w + added[k] * out_features1 + j));
+            hvec_store_32(to + j, acc);
+        }
+#endif
+        for (; j < out_features1; ++j) {
+            int32_t v = from ? from[j] : 0;
+            for (int k = 0; k < removeCount; ++k) v -= w[removed[k] * out_features1 + j];
+            for (int k = 0; k < addCount; ++k)    v += w[added[k] * out_features1 + j];
+            to[j] = v;
+        }
+    }
+
+    // Sums the fc1 rows of the active features (sparse → dense)
+    void accumulate_features(const InputLayer& fc1, const int* active_features, int count,
+                             int32_t* acc) {
+        apply_rows(fc1, nullptr, acc, active_features, count, nullptr, 0);
+    }
+
+    // Bias + ClippedReLU for first layer (clamped to [0, 128] which represents
+    // [0.0, 1.0] float). The result fits int16, which lets fc2 use madd.
+    void first_layer_output(const int32_t* acc, const InputLayer& fc1, int16_t* h1) {
         const int out_features1 = fc1.cols;
+
+        int j = 0;
+#ifdef HARENN_VECTOR
+        // packs saturates, so clipping after the pack gives the same result
+        const hvec16_t zero = hvec_set_16(0);
+        const hvec16_t one  = hvec_set_16(128);
+        const int32_t* b    = fc1.bias.data();
+        for (; j <= out_features1 - Lanes16; j += Lanes16) {
+            hvec32_t lo = hvec_add_32(hvec_load_32(acc + j), hvec_load_32(b + j));
+            hvec32_t hi = hvec_add_32(hvec_load_32(acc + j + Lanes32), hvec_load_32(b + j + Lanes32));
+            hvec_store_16(h1 + j, hvec_min_16(one, hvec_max_16(zero, hvec_pack_32_16(lo, hi))));
+        }
+#endif
+        for (; j < out_features1; ++j)
+            h1[j] = int16_t(std::clamp(acc[j] + fc1.bias[j], 0, 128));
+    }
+
+    // Second layer (dense → dense) for N positions: every chunk of an fc2 row is
+    // loaded once and multiplied with the first layer outputs of all of them.
+    // With h1 <= 128 and 512 inputs the exact sum always fits int32, so the lanes
+    // can be reduced in 32 bits.
+    template<int N>
+    void second_layer(const int16_t* const* h1, const HiddenLayer& fc2, int32_t* const* h2) {
+        const int out_features1 = fc2.cols;
         const int out_features2 = fc2.rows; // fc2 is (out_features2, out_features1)
-        
-        std::fill(h1, h1 + out_features1, 0);
-
-        // First layer (sparse → dense) - AVX2 optimized
-        for (int i = 0; i < count; ++i) {
-            const int feat_idx = active_features[i];
-            const int16_t* feat_weights = &fc1.weights[feat_idx * out_features1];
-            
-            int j = 0;
-            for (; j <= out_features1 - 8; j += 8) {
-                __m128i w_vec_16 = _mm_loadu_si128((const __m128i*)(feat_weights + j));
-                __m256i w_vec = _mm256_cvtepi16_epi32(w_vec_16);
-                __m256i h1_vec = _mm256_loadu_si256((const __m256i*)(h1 + j));
-                h1_vec = _mm256_add_epi32(h1_vec, w_vec);
-                _mm256_storeu_si256((__m256i*)(h1 + j), h1_vec);
+        const int16_t* w2 = fc2.weights.data();
+
+        for (int i = 0; i < out_features2; ++i) {
+            const int16_t* w2_row = &w2[i * out_features1];
+
+            int k = 0;
+#ifdef HARENN_VECTOR
+            hvec32_t acc_vec[N];
+            for (int b = 0; b < N; ++b)
+                acc_vec[b] = hvec_zero();
+            for (; k <= out_features1 - Lanes16; k += Lanes16) {
+                const hvec16_t w_vec = hvec_load_16(w2_row + k);
+                for (int b = 0; b < N; ++b)
+                    acc_vec[b] = hvec_dot_16(acc_vec[b], hvec_load_16(h1[b] + k), w_vec);
             }
-            // Fallback for remainder
-            for (; j < out_features1; ++j) {
-                h1[j] += feat_weights[j];
+#endif
+            for (int b = 0; b < N; ++b) {
+                int64_t sum = fc2.bias[i];
+#ifdef HARENN_VECTOR
+                sum += hvec_hadd_32(acc_vec[b]);
+#endif
+                for (int r = k; r < out_features1; ++r)
+                    sum += (int64_t)h1[b][r] * w2_row[r];
+
+                h2[b][i] = (int32_t)std::clamp<int64_t>(sum, 0, 16384);
             }
         }
+    }
+
+#if defined(USE_SSSE3)
+    // Same register setup as the NNUE AffineTransform
+    #if defined(USE_AVX512)
+    using qvec_t = __m512i;
+        #define qvec_zero() _mm512_setzero_si512()
+        #define qvec_set_32 _mm512_set1_epi32
+        #define qvec_load(a) _mm512_loadu_si512(a)
+        #define qvec_store(a, b) _mm512_storeu_si512(a, b)
+        #define qvec_add_dpbusd_32 Eval::NNUE::SIMD::m512_add_dpbusd_epi32
+    #elif defined(USE_AVX2)
+    using qvec_t = __m256i;
+        #define qvec_zero() _mm256_setzero_si256()
+        #define qvec_set_32 _mm256_set1_epi32
+        #define qvec_load(a) _mm256_loadu_si256(a)
+        #define qvec_store(a, b) _mm256_storeu_si256((__m256i*)(a), b)
+        #define qvec_add_dpbusd_32 Eval::NNUE::SIMD::m256_add_dpbusd_epi32
+    #else
+    using qvec_t = __m128i;
+        #define qvec_zero() _mm_setzero_si128()
+        #define qvec_set_32 _mm_set1_epi32
+        #define qvec_load(a) _mm_loadu_si128(a)
+        #define qvec_store(a, b) _mm_storeu_si128((__m128i*)(a), b)
+        #define qvec_add_dpbusd_32 Eval::NNUE::SIMD::m128_add_dpbusd_epi32
+    #endif
+
+    constexpr int QLanes = sizeof(qvec_t) / sizeof(int32_t);
 
-        // Bias + ClippedReLU for first layer (clamped to [0, 128] which represents [0.0, 1.0] float)
-        // AVX2 optimized
-        {
-            __m256i zero_vec = _mm256_setzero_si256();
-            __m256i max_vec = _mm256_set1_epi32(128);
-            int j = 0;
-            for (; j <= out_features1 - 8; j += 8) {
-                __m256i h1_vec = _mm256_loadu_si256((const __m256i*)(h1 + j));
-                __m256i bias_vec = _mm256_loadu_si256((const __m256i*)(fc1.bias.data() + j));
-                __m256i val_vec = _mm256_add_epi32(h1_vec, bias_vec);
-                val_vec = _mm256_max_epi32(zero_vec, val_vec);
-                val_vec = _mm256_min_epi32(max_vec, val_vec);
-                _mm256_storeu_si256((__m256i*)(h1 + j), val_vec);
+    // Sums of outputs [o0, o0 + Regs * QLanes) for N positions. Every group of
+    // 4 inputs is broadcast once per position and multiplied with the weights
+    // of all outputs in the tile.
+    template<int N, int Regs>
+    void int8_tile(const uint8_t* const* h1, const int8_t* w8, int in_features,
+                   int out_features, int o0, int32_t (*sums)[MaxL2Size]) {
+        qvec_t acc[N][Regs];
+        for (int b = 0; b < N; ++b)
+            for (int r = 0; r < Regs; ++r)
+                acc[b][r] = qvec_zero();
+
+        for (int g = 0; g < in_features / 4; ++g) {
+            const auto col = reinterpret_cast<const qvec_t*>(w8 + (g * out_features + o0) * 4);
+
+            qvec_t in[N];
+            for (int b = 0; b < N; ++b) {
+                int32_t group;
+                std::memcpy(&group, h1[b] + g * 4, 4);
+                in[b] = qvec_set_32(group);
             }
-            for (; j < out_features1; ++j) {
-                h1[j] = std::clamp(h1[j] + fc1.bias[j], 0, 128);
+            for (int r = 0; r < Regs; ++r) {
+                const qvec_t w = qvec_load(col + r);
+                for (int b = 0; b < N; ++b)
+                    qvec_add_dpbusd_32(acc[b][r], in[b], w);
             }
         }
 
-        // Second layer (dense → dense) - AVX2 optimized
-        std::fill(h2, h2 + out_features2, 0);
-        const int16_t* w2 = fc2.weights.data();
-        const int32_t* bias2_ptr = fc2.bias.data();
-        
-        for (int i = 0; i < out_features2; ++i) {
-            int64_t sum = bias2_ptr[i];
-            const int16_t* w2_row = &w2[i * out_features1];
-            
-            __m256i acc_vec = _mm256_setzero_si256();
-            
-            int j = 0;
-            for (; j <= out_features1 - 8; j += 8) {
-                __m256i h1_vec = _mm256_loadu_si256((const __m256i*)(h1 + j));
-                __m128i w2_vec_16 = _mm_loadu_si128((const __m128i*)(w2_row + j));
-                __m256i w2_vec = _mm256_cvtepi16_epi32(w2_vec_16);
-                acc_vec = _mm256_add_epi32(acc_vec, _mm256_mullo_epi32(h1_vec, w2_vec));
+        for (int b = 0; b < N; ++b)
+            for (int r = 0; r < Regs; ++r)
+                qvec_store(&sums[b][o0 + r * QLanes], acc[b][r]);
+    }
+#endif
+
+    // Second layer of an HNN5 model for N positions. The int8 weights are stored
+    // like the NNUE AffineTransform scrambles them: for each group of 4 inputs
+    // the 4 weights of every output, so a register of weights covers QLanes
+    // outputs and dpbusd multiplies it with 4 broadcast inputs. h1 <= 128 is
+    // unsigned, and with |w| <= 127 the int16 pair sums of maddubs cannot
+    // saturate. NEON's dot product is signed-only, so it uses the scalar loop.
+    template<int N>
+    void second_layer_int8(const uint8_t* const* h1, const HiddenLayer& fc2, const int8_t* w8,
+                           float scale, int32_t* const* h2) {
+        const int out_features1 = fc2.cols; // a multiple of 4
+        const int out_features2 = fc2.rows; // a multiple of 16
+
+        alignas(64) int32_t sums[N][MaxL2Size];
+
+#if defined(USE_SSSE3)
+        // Tiles of 8 registers for one position, 2 per position when batched,
+        // which keeps the accumulators in registers
+        constexpr int Regs = N == 1 ? 8 : 2;
+        int o0 = 0;
+        for (; o0 + Regs * QLanes <= out_features2; o0 += Regs * QLanes)
+            int8_tile<N, Regs>(h1, w8, out_features1, out_features2, o0, sums);
+        for (; o0 < out_features2; o0 += QLanes)
+            int8_tile<N, 1>(h1, w8, out_features1, out_features2, o0, sums);
+#else
+        for (int b = 0; b < N; ++b)
+            std::fill(sums[b], sums[b] + out_features2, 0);
+        for (int g = 0; g < out_features1 / 4; ++g)
+            for (int o = 0; o < out_features2; ++o) {
+                const int8_t* w = w8 + (g * out_features2 + o) * 4;
+                for (int b = 0; b < N; ++b) {
+                    const uint8_t* in = h1[b] + g * 4;
+                    sums[b][o] += in[0] * w[0] + in[1] * w[1] + in[2] * w[2] + in[3] * w[3];
+                }
             }
-            
-            int32_t acc_arr[8];
-            _mm256_storeu_si256((__m256i*)acc_arr, acc_vec);
-            int64_t horizontal_sum = acc_arr[0] + acc_arr[1] + acc_arr[2] + acc_arr[3] +
-                                     acc_arr[4] + acc_arr[5] + acc_arr[6] + acc_arr[7];
-            sum += horizontal_sum;
-            
-            // Remainder loop
-            for (; j < out_features1; ++j) {
-                sum += (int64_t)h1[j] * w2_row[j];
+#endif
+
+        for (int b = 0; b < N; ++b)
+            for (int o = 0; o < out_features2; ++o) {
+                const float v = std::clamp(fc2.bias[o] + scale * sums[b][o], 0.0f, 16384.0f);
+                h2[b][o] = int32_t(v + 0.5f);
             }
-            
-            h2[i] = (int32_t)std::clamp(sum, 0LL, 16384LL);
-        }
     }
-    
-    float run_head_single(const int32_t* h2, int out_features, const Layer& head) {
-        int64_t sum = head.bias[0];
+
+#if defined(USE_SSSE3)
+    #undef qvec_zero
+    #undef qvec_set_32
+    #undef qvec_load
+    #undef qvec_store
+    #undef qvec_add_dpbusd_32
+#endif
+
+    // Applies the per-layer scale of an HNN5 head, 1 for HNN4. The sum is exact
+    // in double, so HNN4 logits round exactly as before.
+    float head_logit(int32_t bias, float scale, int64_t sum) {
+        return float(double(bias) + double(scale) * double(sum)) / (128.0f * 128.0f * 128.0f);
+    }
+
+    float run_head_single(const int32_t* h2, int out_features, const OutputLayer& head, float scale) {
+        int64_t sum = 0;
         const int16_t* w = head.weights.data();
-        const int32_t* h2_ptr = h2;
-        
-        __m256i acc_vec = _mm256_setzero_si256();
-        
+
         int j = 0;
-        for (; j <= out_features - 8; j += 8) {
-            __m256i h2_vec = _mm256_loadu_si256((const __m256i*)(h2_ptr + j));
-            __m128i w_vec_16 = _mm_loadu_si128((const __m128i*)(w + j));
-            __m256i w_vec = _mm256_cvtepi16_epi32(w_vec_16);
-            acc_vec = _mm256_add_epi32(acc_vec, _mm256_mullo_epi32(h2_vec, w_vec));
+#ifdef HARENN_VECTOR
+        // h2 is clipped to [0, 16384] so it packs to int16 losslessly
+        hvec32_t acc_vec = hvec_zero();
+        for (; j <= out_features - Lanes16; j += Lanes16) {
+            hvec16_t h2_vec = hvec_pack_32_16(hvec_load_32(h2 + j), hvec_load_32(h2 + j + Lanes32));
+            acc_vec = hvec_dot_16(acc_vec, h2_vec, hvec_load_16(w + j));
         }
-        
-        int32_t acc_arr[8];
-        _mm256_storeu_si256((__m256i*)acc_arr, acc_vec);
-        int64_t horizontal_sum = acc_arr[0] + acc_arr[1] + acc_arr[2] + acc_arr[3] +
-                                 acc_arr[4] + acc_arr[5] + acc_arr[6] + acc_arr[7];
-        sum += horizontal_sum;
-        
-        for (; j < out_features; ++j) {
-            sum += (int64_t)h2_ptr[j] * w[j];
+        sum += hvec_hadd_64(acc_vec);
+#endif
+        for (; j < out_features; ++j)
+            sum += (int64_t)h2[j] * w[j];
+
+        return head_logit(head.bias[0], scale, sum);
+    }
+
+    // Fused output layer: computes the four head logits in a single pass over h2.
+    // Every HeadChunk-input chunk of the packed weights holds the rows of all four
+    // heads back to back, so each packed h2 vector is loaded once and feeds four
+    // dot products.
+    void run_heads_fused(const int32_t* h2, int out_features, const int16_t* w,
+                         const int32_t* bias, const float* scale, float* out) {
+        constexpr int HeadCount = 4;
+        const int chunks = out_features / HeadChunk;
+
+        int64_t sums[HeadCount] = {};
+
+#ifdef HARENN_VECTOR
+        static_assert(HeadChunk % Lanes16 == 0);
+        hvec32_t acc0 = hvec_zero(), acc1 = hvec_zero(), acc2 = hvec_zero(), acc3 = hvec_zero();
+        for (int c = 0; c < chunks; ++c) {
+            const int16_t* wc = w + c * HeadCount * HeadChunk;
+            for (int p = 0; p < HeadChunk; p += Lanes16) {
+                const int32_t* h = h2 + c * HeadChunk + p;
+                hvec16_t h2_vec = hvec_pack_32_16(hvec_load_32(h), hvec_load_32(h + Lanes32));
+                acc0 = hvec_dot_16(acc0, h2_vec, hvec_load_16(wc + 0 * HeadChunk + p));
+                acc1 = hvec_dot_16(acc1, h2_vec, hvec_load_16(wc + 1 * HeadChunk + p));
+                acc2 = hvec_dot_16(acc2, h2_vec, hvec_load_16(wc + 2 * HeadChunk + p));
+                acc3 = hvec_dot_16(acc3, h2_vec, hvec_load_16(wc + 3 * HeadChunk + p));
+            }
+        }
+        // Widen to int64 before summing the lanes, as run_head_single does
+        sums[0] += hvec_hadd_64(acc0);
+        sums[1] += hvec_hadd_64(acc1);
+        sums[2] += hvec_hadd_64(acc2);
+        sums[3] += hvec_hadd_64(acc3);
+#else
+        for (int c = 0; c < chunks; ++c)
+            for (int k = 0; k < HeadCount; ++k)
+                for (int j = 0; j < HeadChunk; ++j)
+                    sums[k] += (int64_t)h2[c * HeadChunk + j] * w[(c * HeadCount + k) * HeadChunk + j];
+#endif
+
+        // Inputs past the last full chunk are stored interleaved per input
+        const int16_t* tail = w + chunks * HeadCount * HeadChunk;
+        for (int k = 0; k < HeadCount; ++k) {
+            for (int j = chunks * HeadChunk; j < out_features; ++j)
+                sums[k] += (int64_t)h2[j] * tail[(j - chunks * HeadChunk) * HeadCount + k];
+            out[k] = head_logit(bias[k], scale[k], sums[k]);
         }
-        
-        return (float)sum / (128.0f * 128.0f * 128.0f);
+    }
+
+#undef hvec_zero
+#undef hvec_set_16
+#undef hvec_load_32
+#undef hvec_store_32
+#undef hvec_load_16
+#undef hvec_store_16
+#undef hvec_load_16_32
+#undef hvec_add_32
+#undef hvec_sub_32
+#undef hvec_max_16
+#undef hvec_min_16
+#undef hvec_pack_32_16
+#undef hvec_dot_16
+#undef hvec_hadd_32
+    // Collects the input features of every piece on the board
+    int extract_features(const Position& pos, int* active_features) {
+        int count = 0;
+
+        // Positions set up from a FEN are not checked for piece counts
+        Bitboard pieces = pos.pieces();
+        while (pieces && count < MaxActiveFeatures) {
+            Square sq = pop_lsb(pieces);
+            active_features[count++] = feature_index(sq, pos.piece_on(sq));
+        }
+
+        return count;
+    }
+
+    // Features a legal move adds and removes, the same delta do_move() reports
+    // through its DirtyPiece
+    void move_features(const Position& pos, Move m, int* added, int& addCount,
+                       int* removed, int& removeCount) {
+        const Color  us   = pos.side_to_move();
+        const Square from = m.from_sq();
+        const Square to   = m.to_sq();
+        const Piece  pc   = pos.moved_piece(m);
+
+        addCount = removeCount = 0;
+        removed[removeCount++] = feature_index(from, pc);
+
+        if (m.type_of() == CASTLING) {
+            // Castling is encoded as king captures rook
+            const bool  kingSide = to > from;
+            const Piece rook     = make_piece(us, ROOK);
+            removed[removeCount++] = feature_index(to, rook);
+            added[addCount++] = feature_index(relative_square(us, kingSide ? SQ_G1 : SQ_C1), pc);
+            added[addCount++] = feature_index(relative_square(us, kingSide ? SQ_F1 : SQ_D1), rook);
+            return;
+        }
+
+        if (m.type_of() == EN_PASSANT)
+            removed[removeCount++] = feature_index(to - pawn_push(us), make_piece(~us, PAWN));
+        else if (pos.piece_on(to) != NO_PIECE)
+            removed[removeCount++] = feature_index(to, pos.piece_on(to));
+
+        added[addCount++] = feature_index(to, m.type_of() == PROMOTION ? make_piece(us, m.promotion_type()) : pc);
+    }
+
+    // Active features of the position after a legal move, from those of 'pos'
+    int child_features(const Position& pos, const int* active_features, int count, Move m,
+                       int* childFeatures) {
+        int added[2], removed[3], addCount, removeCount;
+        move_features(pos, m, added, addCount, removed, removeCount);
+
+        int c = 0;
+        for (int j = 0; j < count; ++j)
+            if (std::find(removed, removed + removeCount, active_features[j]) == removed + removeCount)
+                childFeatures[c++] = active_features[j];
+        for (int j = 0; j < addCount; ++j)
+            childFeatures[c++] = added[j];
+        return c;
     }
 }
 
 EvalResult Network::forward(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
-    const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) {
-        return EvalResult{0.0f, 0.0f, 0.0f, 0.0f};
+    int32_t acc[MaxL1Size];
+    accumulate_features(fc1, active_features, count, acc);
+    return forward(acc);
+}
+
+EvalResult Network::forward(const int32_t* acc) const {
+    int32_t  h2[MaxL2Size];
+    int32_t* hidden[] = {h2};
+
+    propagate(&acc, 1, hidden);
+    return run_heads(h2);
+}
+
+void Network::forward_batch(const int* const* active_features, const int* counts, int n,
+                            EvalResult* out) const {
+    for (int i = 0; i < n; i += BatchSize) {
+        const int nb = std::min(BatchSize, n - i);
+
+        int32_t        acc[BatchSize][MaxL1Size];
+        const int32_t* accs[BatchSize];
+        for (int b = 0; b < nb; ++b) {
+            accumulate_features(fc1, active_features[i + b], counts[i + b], acc[b]);
+            accs[b] = acc[b];
+        }
+        forward_batch(accs, nb, out + i);
     }
-    int32_t h1[512];
-    int32_t h2[256];
-    
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
+}
+
+void Network::forward_batch(const int32_t* const* accs, int n, EvalResult* out) const {
+    for (int i = 0; i < n; i += BatchSize) {
+        const int nb = std::min(BatchSize, n - i);
+
+        int32_t  h2[BatchSize][MaxL2Size];
+        int32_t* hidden[BatchSize];
+        for (int b = 0; b < nb; ++b)
+            hidden[b] = h2[b];
+
+        if (nb == BatchSize)
+            propagate(accs + i, BatchSize, hidden);
+        else
+            for (int b = 0; b < nb; ++b)
+                propagate(accs + i + b, 1, hidden + b);
+
+        for (int b = 0; b < nb; ++b)
+            out[i + b] = run_heads(h2[b]);
+    }
+}
+
+void Network::propagate(const int32_t* const* accs, int n, int32_t* const* h2) const {
+    assert(n == 1 || n == BatchSize);
+
+    int16_t        h1[BatchSize][MaxL1Size];
+    const int16_t* in[BatchSize];
+    for (int b = 0; b < n; ++b) {
+        first_layer_output(accs[b], fc1, h1[b]);
+        in[b] = h1[b];
+    }
+
+    if (!quantized) {
+        if (n == BatchSize)
+            second_layer<BatchSize>(in, fc2, h2);
+        else
+            second_layer<1>(in, fc2, h2);
+        return;
+    }
+
+    // h1 is clipped to [0, 128], so it narrows to uint8 losslessly
+    alignas(64) uint8_t h1u8[BatchSize][MaxL1Size];
+    const uint8_t*      in8[BatchSize];
+    for (int b = 0; b < n; ++b) {
+        for (int j = 0; j < fc1.cols; ++j)
+            h1u8[b][j] = uint8_t(h1[b][j]);
+        in8[b] = h1u8[b];
+    }
+
+    if (n == BatchSize)
+        second_layer_int8<BatchSize>(in8, fc2, fc2_weights8.data(), fc2_scale, h2);
+    else
+        second_layer_int8<1>(in8, fc2, fc2_weights8.data(), fc2_scale, h2);
+}
+
+// Shared hidden layer computation for lazy evaluation
+void Network::compute_hidden_layer(const int* active_features, int count, int32_t* h2) const {
+    int32_t        acc[MaxL1Size];
+    const int32_t* accs[] = {acc};
+    accumulate_features(fc1, active_features, count, acc);
+    propagate(accs, 1, &h2);
+}
+
+EvalResult Network::run_heads(const int32_t* h2) const {
+    float logits[HeadCount];
+    run_heads_fused(h2, fc2.rows, heads.data(), heads_bias, heads_scale, logits);
 
     EvalResult res;
-    res.eval = run_head_single(h2, out_features2, eval_head) * eval_std + eval_mean;
-    res.tau  = fast_sigmoid(run_head_single(h2, out_features2, tau_head));
-    res.rho  = fast_sigmoid(run_head_single(h2, out_features2, rho_head));
-    res.rs   = fast_sigmoid(run_head_single(h2, out_features2, rs_head));
+    res.eval = logits[0] * eval_std + eval_mean;
+    res.tau  = fast_sigmoid(logits[1]);
+    res.rho  = fast_sigmoid(logits[2]);
+    res.rs   = fast_sigmoid(logits[3]);
 
     return res;
 }
 
 float Network::compute_eval(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
-    const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) return 0.0f;
-    int32_t h1[512];
-    int32_t h2[256];
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
-    return run_head_single(h2, out_features2, eval_head) * eval_std + eval_mean;
+    int32_t h2[MaxL2Size];
+    compute_hidden_layer(active_features, count, h2);
+    return run_head_single(h2, fc2.rows, eval_head, heads_scale[0]) * eval_std + eval_mean;
 }
 
 float Network::compute_tau(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
-    const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) return 0.5f;
-    int32_t h1[512];
-    int32_t h2[256];
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
-    return fast_sigmoid(run_head_single(h2, out_features2, tau_head));
+    int32_t h2[MaxL2Size];
+    compute_hidden_layer(active_features, count, h2);
+    return fast_sigmoid(run_head_single(h2, fc2.rows, tau_head, heads_scale[1]));
 }
 
 float Network::compute_rho(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
-    const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) return 0.5f;
-    int32_t h1[512];
-    int32_t h2[256];
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
-    return fast_sigmoid(run_head_single(h2, out_features2, rho_head));
+    int32_t h2[MaxL2Size];
+    compute_hidden_layer(active_features, count, h2);
+    return fast_sigmoid(run_head_single(h2, fc2.rows, rho_head, heads_scale[2]));
 }
 
 float Network::compute_rs(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
-    const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) return 0.5f;
-    int32_t h1[512];
-    int32_t h2[256];
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
-    return fast_sigmoid(run_head_single(h2, out_features2, rs_head));
+    int32_t h2[MaxL2Size];
+    compute_hidden_layer(active_features, count, h2);
+    return fast_sigmoid(run_head_single(h2, fc2.rows, rs_head, heads_scale[3]));
 }
 
 std::pair<float, float> Network::compute_rho_and_rs(const int* active_features, int count) const {
-    const int out_features1 = fc1.cols;
+    int32_t acc[MaxL1Size];
+    accumulate_features(fc1, active_features, count, acc);
+    return compute_rho_and_rs(acc);
+}
+
+std::pair<float, float> Network::compute_rho_and_rs(const int32_t* acc) const {
+    EvalResult res = forward(acc);
+    return {res.rho, res.rs};
+}
+
+std::string Network::benchmark_heads(const int* active_features, int count, int iterations) const {
+    using Clock = std::chrono::steady_clock;
+
+    int32_t        acc[MaxL1Size];
+    int32_t        h2[MaxL2Size];
+    const int32_t* accs[]   = {acc};
+    int32_t*       hidden[] = {h2};
+    accumulate_features(fc1, active_features, count, acc);
+    propagate(accs, 1, hidden);
+
     const int out_features2 = fc2.rows;
-    if (out_features1 > 512 || out_features2 > 256) {
-        return {0.5f, 0.5f};
+    volatile float sink = 0.0f;
+
+    // h2[0] is rewritten every iteration so the loops cannot be hoisted
+    auto t0 = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        h2[0] = i & 127;
+        float s = run_head_single(h2, out_features2, eval_head, heads_scale[0])
+                + run_head_single(h2, out_features2, tau_head, heads_scale[1])
+                + run_head_single(h2, out_features2, rho_head, heads_scale[2])
+                + run_head_single(h2, out_features2, rs_head, heads_scale[3]);
+        sink = sink + s;
+    }
+    auto t1 = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        h2[0] = i & 127;
+        float logits[HeadCount];
+        run_heads_fused(h2, out_features2, heads.data(), heads_bias, heads_scale, logits);
+        sink = sink + logits[0] + logits[1] + logits[2] + logits[3];
     }
-    int32_t h1[512];
-    int32_t h2[256];
-    compute_hidden_layer(active_features, count, fc1, fc2, h1, h2);
-    float rho = fast_sigmoid(run_head_single(h2, out_features2, rho_head));
-    float rs  = fast_sigmoid(run_head_single(h2, out_features2, rs_head));
-    return {rho, rs};
+    auto t2 = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        EvalResult r = forward(active_features, count);
+        sink = sink + r.eval;
+    }
+    auto t3 = Clock::now();
+
+    auto ns = [&](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::nano>(b - a).count() / std::max(iterations, 1);
+    };
+
+    std::stringstream ss;
+    ss << "Heads, 4 x single (ns/query): " << ns(t0, t1)
+       << "\nHeads, fused      (ns/query): " << ns(t1, t2)
+       << "\nFull forward      (ns/query): " << ns(t2, t3);
+    (void)sink;
+    return ss.str();
 }
 
-static Network* global_net = nullptr;
-static bool model_loaded = false;
+void Network::refresh_accumulator(const int* active_features, int count, int32_t* acc) const {
+    accumulate_features(fc1, active_features, count, acc);
+}
 
-void GuidanceProvider::init() {
-    init_sigmoid_table();
-    
-    if (!global_net) {
-        global_net = new Network();
-    }
-    
-    if (global_net->load("nextfish.harenn")) {
-        model_loaded = true;
-        sync_cout << "info string HARENN: Full 4-Head Model loaded successfully" << sync_endl;
+void Network::update_accumulator(const int32_t* from, int32_t* to,
+                                 const int* added, int addCount,
+                                 const int* removed, int removeCount) const {
+    apply_rows(fc1, from, to, added, addCount, removed, removeCount);
+}
+
+const int32_t* AccumulatorStack::evaluate(const Position& pos, const Network& net) noexcept {
+    const std::size_t last = size - 1;
+
+    if (states[last].computed)
+        return states[last].sums;
+
+    // Walk back to the closest computed ancestor, giving up once replaying
+    // the moves would cost more than summing all pieces again.
+    std::size_t begin = last;
+    while (begin > 0 && !states[begin].computed && last - begin < MaxReplay)
+        --begin;
+
+    if (!states[begin].computed) {
+        int active_features[MaxActiveFeatures];
+        int count = extract_features(pos, active_features);
+        net.refresh_accumulator(active_features, count, states[last].sums);
     } else {
-        model_loaded = false;
-        sync_cout << "info string HARENN: Failed to load model. Check nextfish.harenn path" << sync_endl;
+        for (std::size_t i = begin + 1; i <= last; ++i) {
+            const DirtyPiece& dp = states[i].dirty;
+            int added[2], removed[2];
+            int addCount = 0, removeCount = 0;
+
+            removed[removeCount++] = feature_index(dp.from, dp.pc);
+            if (dp.to != SQ_NONE)
+                added[addCount++] = feature_index(dp.to, dp.pc);
+            if (dp.remove_sq != SQ_NONE)
+                removed[removeCount++] = feature_index(dp.remove_sq, dp.remove_pc);
+            if (dp.add_sq != SQ_NONE)
+                added[addCount++] = feature_index(dp.add_sq, dp.add_pc);
+
+            net.update_accumulator(states[i - 1].sums, states[i].sums,
+                                   added, addCount, removed, removeCount);
+            states[i].computed = true;
+        }
     }
+
+    states[last].computed = true;
+    return states[last].sums;
 }
 
-bool GuidanceProvider::is_model_loaded() {
-    return model_loaded;
+std::size_t Network::get_content_hash() const {
+    std::size_t h = 0;
+    for (const float* f : {&eval_mean, &eval_std})
+        hash_combine(h, hash_bytes(reinterpret_cast<const char*>(f), sizeof(float)));
+    hash_combine(h, get_raw_data_hash(fc1.weights));
+    hash_combine(h, get_raw_data_hash(fc1.bias));
+    hash_combine(h, get_raw_data_hash(fc2.weights));
+    hash_combine(h, get_raw_data_hash(fc2.bias));
+    hash_combine(h, get_raw_data_hash(heads));
+    hash_combine(h, get_raw_data_hash(heads_bias));
+    hash_combine(h, get_raw_data_hash(fc2_weights8));
+    for (const float* f : {&fc2_scale, &heads_scale[0], &heads_scale[1], &heads_scale[2], &heads_scale[3]})
+        hash_combine(h, hash_bytes(reinterpret_cast<const char*>(f), sizeof(float)));
+    hash_combine(h, quantized);
+    hash_combine(h, fc1.cols);
+    hash_combine(h, fc2.rows);
+    return h;
 }
 
-EvalResult GuidanceProvider::query(const Position& pos, NumaReplicatedAccessToken numaToken) {
-    (void)numaToken;
-    if (!model_loaded || !global_net) {
-        return EvalResult{0.0f, 0.0f, 0.0f, 0.0f};
+namespace {
+    // Parses a model file through a read-only mapping, which saves the heap
+    // buffer of the whole file. This is not zero-copy: the weights are still
+    // copied into 'net', and from there into the shared replica. They cannot be
+    // used from the file in place, as the replica has to be a trivially copyable
+    // Network for NUMA replication and for sharing between processes.
+    bool load_mapped(Network& net, const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) return false;
+
+        struct stat statbuf;
+        if (fstat(fd, &statbuf) == -1 || statbuf.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* base = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) return false;
+
+        bool ok = net.load(static_cast<const char*>(base), statbuf.st_size);
+        munmap(base, statbuf.st_size);
+        return ok;
+#else
+        HANDLE fd = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fd == INVALID_HANDLE_VALUE) return false;
+
+        DWORD  size_high;
+        DWORD  size_low = GetFileSize(fd, &size_high);
+        HANDLE mapping  = CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
+        CloseHandle(fd);
+        if (!mapping) return false;
+
+        void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        bool  ok   = base && net.load(static_cast<const char*>(base), (uint64_t(size_high) << 32) | size_low);
+        if (base) UnmapViewOfFile(base);
+        CloseHandle(mapping);
+        return ok;
+#endif
     }
-    int active_features[64];
-    int count = 0;
-
-    Bitboard pieces = pos.pieces();
-    while (pieces) {
-        Square sq = pop_lsb(pieces);
-        Piece pc = pos.piece_on(sq);
-        if (pc != NO_PIECE) {
-            int py_sq = (int)sq ^ 56;  // Convert bottom-up to top-down (a1->a8 rank flip)
-            int py_pc = (int)pc - 1;  // W:0-5, B:6-11
-            active_features[count++] = py_sq * 12 + py_pc;
+}
+
+GuidanceProvider::GuidanceProvider(NumaReplicationContext& numaContext) :
+    networks(numaContext) {
+    // Thread-safe, engines can be built concurrently
+    static const bool sigmoidTableReady = (init_sigmoid_table(), true);
+    (void) sigmoidTableReady;
+}
+
+void GuidanceProvider::load(const std::string& rootDirectory, const std::string& file) {
+    // Heap-allocate because sizeof(Network) is large
+    auto net = std::make_unique<Network>();
+
+    // Same search order as the NNUE networks: the embedded default model, then
+    // the working directory, then the directory of the binary.
+    for (const std::string& directory : {std::string("<internal>"), std::string(), rootDirectory}) {
+        bool loaded = directory == "<internal>"
+                        ? file == HarennFileDefaultName
+                            && net->load(reinterpret_cast<const char*>(gEmbeddedHarennData), gEmbeddedHarennSize)
+                        : load_mapped(*net, directory + file);
+        if (loaded) {
+            networks = std::move(net);
+            modelLoaded = true;
+            sync_cout << "info string HARENN: Full 4-Head Model loaded from "
+                      << (directory == "<internal>" ? "embedded " + file : directory + file) << sync_endl;
+            return;
         }
     }
 
-    return global_net->forward(active_features, count);
+    modelLoaded = false;
+    sync_cout << "info string HARENN: Failed to load model " << file << ". Check the HARENN File path" << sync_endl;
 }
 
-std::pair<float, float> GuidanceProvider::query_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken) {
-    (void)numaToken;
-    if (!model_loaded || !global_net) {
-        return {0.5f, 0.5f};
+void GuidanceProvider::ensure_replicated(NumaReplicatedAccessToken numaToken) const {
+    if (modelLoaded)
+        (void) networks[numaToken];
+}
+
+std::string GuidanceProvider::benchmark(const Position& pos, int iterations) const {
+    using Clock = std::chrono::steady_clock;
+
+    if (!modelLoaded)
+        return "HARENN model not loaded";
+
+    const Network& net = *networks;
+
+    int active_features[MaxActiveFeatures];
+    int count = extract_features(pos, active_features);
+
+    std::stringstream ss;
+    ss << net.benchmark_heads(active_features, count, iterations);
+
+    // Children of the position: batched from the parent's sums against one
+    // full forward() per child
+    std::vector<Move> moves;
+    for (const auto& m : MoveList<LEGAL>(pos))
+        moves.push_back(m);
+
+    if (moves.empty())
+        return ss.str();
+
+    const int n = int(moves.size());
+    std::vector<std::array<int, MaxActiveFeatures>> childFeatures(n);
+    std::vector<int>                 childCounts(n);
+    for (int i = 0; i < n; ++i)
+        childCounts[i] = child_features(pos, active_features, count, moves[i], childFeatures[i].data());
+
+    const int rounds = std::max(iterations / 1000, 1);
+    std::vector<EvalResult> separate(n), batched;
+    volatile float sink = 0.0f;
+
+    auto t0 = Clock::now();
+    for (int r = 0; r < rounds; ++r)
+        for (int i = 0; i < n; ++i) {
+            separate[i] = net.forward(childFeatures[i].data(), childCounts[i]);
+            sink = sink + separate[i].eval;
+        }
+    auto t1 = Clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        batched = query_children(pos, moves, NumaReplicatedAccessToken(0));
+        sink = sink + batched[0].eval;
     }
-    int active_features[64];
-    int count = 0;
-
-    Bitboard pieces = pos.pieces();
-    while (pieces) {
-        Square sq = pop_lsb(pieces);
-        Piece pc = pos.piece_on(sq);
-        if (pc != NO_PIECE) {
-            int py_sq = (int)sq ^ 56;
-            int py_pc = (int)pc - 1;
-            active_features[count++] = py_sq * 12 + py_pc;
+    auto t2 = Clock::now();
+
+    auto ns = [&](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::nano>(b - a).count() / (double(rounds) * n);
+    };
+
+    int mismatches = 0;
+    for (int i = 0; i < n; ++i)
+        mismatches += std::memcmp(&separate[i], &batched[i], sizeof(EvalResult)) != 0;
+
+    ss << "\nChildren, separate (ns/child): " << ns(t0, t1)
+       << "\nChildren, batched  (ns/child): " << ns(t1, t2)
+       << "\nChildren evaluated: " << n << ", mismatches: " << mismatches;
+    (void)sink;
+    return ss.str();
+}
+
+std::string GuidanceProvider::bench(const std::vector<std::string>& fens, int iterations) const {
+    using Clock = std::chrono::steady_clock;
+
+    if (!modelLoaded)
+        return "HARENN model not loaded";
+
+    const Network& net = *networks;
+
+    std::vector<std::array<int, MaxActiveFeatures>> features(fens.size());
+    std::vector<int>                                counts(fens.size());
+    for (std::size_t i = 0; i < fens.size(); ++i) {
+        StateInfo st;
+        Position  pos;
+        pos.set(fens[i], false, &st);
+        counts[i] = extract_features(pos, features[i].data());
+    }
+
+    const int n = int(fens.size());
+    if (!n)
+        return "HARENN bench: no positions";
+
+    using Path = std::function<float(const int*, int)>;
+    const std::pair<const char*, Path> paths[] = {
+      {"forward", [&](const int* f, int c) { return net.forward(f, c).eval; }},
+      {"compute_rho_and_rs", [&](const int* f, int c) { return net.compute_rho_and_rs(f, c).first; }},
+      {"compute_eval", [&](const int* f, int c) { return net.compute_eval(f, c); }},
+      {"compute_tau", [&](const int* f, int c) { return net.compute_tau(f, c); }},
+      {"compute_rho", [&](const int* f, int c) { return net.compute_rho(f, c); }},
+      {"compute_rs", [&](const int* f, int c) { return net.compute_rs(f, c); }}};
+
+    // Writing a buffer larger than the last level cache of most CPUs evicts
+    // the weights, so the cold runs read them from memory
+    std::vector<char> evict(64 * 1024 * 1024);
+    volatile float    sink = 0.0f;
+
+    std::stringstream ss;
+    ss << "HARENN bench: " << n << " positions, " << iterations << " iterations"
+       << "\nPath                 hot ns/query  queries/s/thread  cold ns/query"
+       << std::fixed;
+
+    for (const auto& [name, run] : paths) {
+        // Hot: the same positions again and again, weights stay in L1/L2
+        auto t0 = Clock::now();
+        for (int it = 0; it < iterations; ++it)
+            for (int i = 0; i < n; ++i)
+                sink = sink + run(features[i].data(), counts[i]);
+        const double hot = std::chrono::duration<double, std::nano>(Clock::now() - t0).count()
+                         / (double(std::max(iterations, 1)) * n);
+
+        // Cold: one query per position, each after the caches were evicted
+        double cold = 0;
+        for (int i = 0; i < n; ++i) {
+            for (std::size_t k = 0; k < evict.size(); k += 64)
+                evict[k] = char(k + i);
+            sink = sink + evict[i];
+            auto t1 = Clock::now();
+            sink = sink + run(features[i].data(), counts[i]);
+            cold += std::chrono::duration<double, std::nano>(Clock::now() - t1).count();
+        }
+        cold /= n;
+
+        ss << "\n" << std::left << std::setw(20) << name << std::right << std::setprecision(1)
+           << std::setw(14) << hot << std::setprecision(0) << std::setw(18) << 1e9 / hot
+           << std::setprecision(1) << std::setw(15) << cold;
+    }
+
+    (void) sink;
+    return ss.str();
+}
+
+std::string GuidanceProvider::quantize(const std::string& file, const std::vector<std::string>& fens) const {
+    using Clock = std::chrono::steady_clock;
+
+    if (!modelLoaded)
+        return "HARENN model not loaded";
+
+    const Network& reference = *networks;
+
+    std::ostringstream model;
+    if (!reference.save_quantized(model))
+        return "HARENN: the loaded model is already quantized";
+
+    const std::string data      = model.str();
+    auto              quantized = std::make_unique<Network>();
+    if (!quantized->load(data.data(), data.size()))
+        return "HARENN: the quantized model has an unsupported shape";
+
+    std::ofstream out(file, std::ios::binary);
+    if (!out.write(data.data(), data.size()))
+        return "HARENN: failed to write " + file;
+
+    // Every position and all of its children, as feature lists
+    std::vector<std::array<int, MaxActiveFeatures>> features;
+    std::vector<int>                                counts;
+    for (const std::string& fen : fens) {
+        StateInfo st;
+        Position  pos;
+        pos.set(fen, false, &st);
+
+        std::array<int, MaxActiveFeatures> parent;
+        const int count = extract_features(pos, parent.data());
+        features.push_back(parent);
+        counts.push_back(count);
+
+        for (const auto& m : MoveList<LEGAL>(pos)) {
+            features.emplace_back();
+            counts.push_back(child_features(pos, parent.data(), count, m, features.back().data()));
         }
     }
 
-    return global_net->compute_rho_and_rs(active_features, count);
+    struct Error {
+        double sum = 0, max = 0;
+        void   add(double e) {
+            sum += std::abs(e);
+            max = std::max(max, std::abs(e));
+        }
+    } eval, tau, rho, rs;
+
+    const int n = int(features.size());
+    for (int i = 0; i < n; ++i) {
+        const EvalResult a = reference.forward(features[i].data(), counts[i]);
+        const EvalResult b = quantized->forward(features[i].data(), counts[i]);
+        eval.add(100.0 * (b.eval - a.eval));
+        tau.add(b.tau - a.tau);
+        rho.add(b.rho - a.rho);
+        rs.add(b.rs - a.rs);
+    }
+
+    auto time = [&](const Network& net) {
+        volatile float sink = 0.0f;
+        auto           t0   = Clock::now();
+        for (int r = 0; r < 20; ++r)
+            for (int i = 0; i < n; ++i)
+                sink = sink + net.forward(features[i].data(), counts[i]).eval;
+        (void) sink;
+        return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (20.0 * std::max(n, 1));
+    };
+
+    std::stringstream ss;
+    ss << "HARENN: HNN5 model written to " << file
+       << "\nPositions: " << n << " (" << fens.size() << " and their children)"
+       << "\nError against HNN4       mean        max";
+    auto row = [&](const char* name, const Error& e) {
+        ss << "\n" << name << std::setw(11) << e.sum / std::max(n, 1) << std::setw(11) << e.max;
+    };
+    ss << std::fixed << std::setprecision(5);
+    row("Evaluation (cp)   ", eval);
+    row("Tactical (Tau)    ", tau);
+    row("Horizon (Rho)     ", rho);
+    row("Resolution (RS)   ", rs);
+    ss << std::setprecision(1)
+       << "\nFull forward (ns/query): HNN4 " << time(reference) << ", HNN5 " << time(*quantized);
+    return ss.str();
+}
+
+std::vector<EvalResult> GuidanceProvider::query_children(const Position& pos, const std::vector<Move>& moves, NumaReplicatedAccessToken numaToken) const {
+    std::vector<EvalResult> results(moves.size(), EvalResult{0.0f, 0.0f, 0.0f, 0.0f});
+    if (!modelLoaded || moves.empty()) {
+        return results;
+    }
+    const Network& net = networks[numaToken];
+
+    int active_features[MaxActiveFeatures];
+    int count = extract_features(pos, active_features);
+
+    int32_t parent[MaxL1Size];
+    net.refresh_accumulator(active_features, count, parent);
+
+    // Children are expanded a block at a time to bound the stack buffers
+    constexpr int Block = 16;
+    const int     n     = int(moves.size());
+    for (int i = 0; i < n; i += Block) {
+        const int nb = std::min(Block, n - i);
+
+        int32_t        acc[Block][MaxL1Size];
+        const int32_t* accs[Block];
+        for (int b = 0; b < nb; ++b) {
+            int added[2], removed[3], addCount, removeCount;
+            move_features(pos, moves[i + b], added, addCount, removed, removeCount);
+            net.update_accumulator(parent, acc[b], added, addCount, removed, removeCount);
+            accs[b] = acc[b];
+        }
+        net.forward_batch(accs, nb, results.data() + i);
+    }
+    return results;
+}
+
+EvalResult GuidanceProvider::query(const Position& pos, NumaReplicatedAccessToken numaToken) const {
+    if (!modelLoaded) {
+        return EvalResult{0.0f, 0.0f, 0.0f, 0.0f};
+    }
+    int active_features[MaxActiveFeatures];
+    int count = extract_features(pos, active_features);
+
+    return networks[numaToken].forward(active_features, count);
+}
+
+std::pair<float, float> GuidanceProvider::query_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken) const {
+    if (!modelLoaded) {
+        return {0.5f, 0.5f};
+    }
+    int active_features[MaxActiveFeatures];
+    int count = extract_features(pos, active_features);
+
+    return networks[numaToken].compute_rho_and_rs(active_features, count);
+}
+
+EvalResult GuidanceProvider::query(const Position& pos, AccumulatorStack& acc, NumaReplicatedAccessToken numaToken) const {
+    if (!modelLoaded) {
+        return EvalResult{0.0f, 0.0f, 0.0f, 0.0f};
+    }
+    const Network& net = networks[numaToken];
+    return net.forward(acc.evaluate(pos, net));
+}
+
+std::pair<float, float> GuidanceProvider::query_rho_and_rs(const Position& pos, AccumulatorStack& acc, NumaReplicatedAccessToken numaToken) const {
+    if (!modelLoaded) {
+        return {0.5f, 0.5f};
+    }
+    const Network& net = networks[numaToken];
+    return net.compute_rho_and_rs(acc.evaluate(pos, net));
 }
 
 } // namespace HARENN
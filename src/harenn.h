@@ -3,9 +3,15 @@
 
 #include "types.h"
 #include "numa.h"
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <string>
-#include <vector>
 #include <utility>
+#include <vector>
 
 namespace Stockfish {
 
@@ -13,6 +19,30 @@ class Position; // Forward declaration
 
 namespace HARENN {
 
+// The default model, embedded in the binary unless embedding is turned off
+#define HarennFileDefaultName "nextfish.harenn"
+
+// Input layer: one feature per (square, piece) pair, 12 piece kinds per square
+constexpr int FeatureCount = 64 * 12;
+
+// Active features of a legal position, one per piece
+constexpr int MaxActiveFeatures = 32;
+
+// Largest hidden layer sizes supported by the fixed-size inference buffers
+constexpr int MaxL1Size = 512;
+constexpr int MaxL2Size = 256;
+
+// The output heads are packed in chunks of this many inputs, one int16
+// register at the widest SIMD width
+constexpr int HeadChunk = 32;
+
+// Maps a piece on a square to its input feature, matching the training
+// encoding: squares are rank-flipped (a8 = 0) and pieces are ordered
+// white P N B R Q K, then black p n b r q k.
+inline int feature_index(Square s, Piece pc) {
+    return (int(s) ^ 56) * 12 + int(color_of(pc)) * 6 + int(type_of(pc)) - 1;
+}
+
 struct EvalResult {
     float eval;
     float tau;
@@ -20,17 +50,35 @@ struct EvalResult {
     float rs;
 };
 
+// Weights are stored inline at their largest supported size so that a Network
+// is trivially copyable and can be replicated per NUMA node and shared between
+// processes like the NNUE networks. 'rows' and 'cols' give the loaded shape.
+template<std::size_t WeightCount, std::size_t BiasCount>
 struct Layer {
     int rows, cols;
-    std::vector<int16_t> weights;
-    std::vector<int32_t> bias;
+    alignas(64) std::array<int16_t, WeightCount> weights;
+    alignas(64) std::array<int32_t, BiasCount>   bias;
 };
 
+using InputLayer  = Layer<FeatureCount * MaxL1Size, MaxL1Size>;
+using HiddenLayer = Layer<MaxL2Size * MaxL1Size, MaxL2Size>;
+using OutputLayer = Layer<MaxL2Size, 1>;
+
+// Model formats:
+//   HNN4: int16 weights and int32 biases in every layer
+//   HNN5: as HNN4, but fc2 and the heads hold int8 weights and a float scale per
+//         layer. Their outputs are bias + scale * (input . weights).
 class Network {
 public:
-    bool load(const std::string& filename);
+    // Parses an HNN4 or HNN5 model from memory
+    bool load(const char* data, std::size_t size);
+
+    // Writes an HNN4 model as HNN5, quantizing fc2 and each head to int8 with
+    // one scale per layer. Returns false if the model is already quantized.
+    bool save_quantized(std::ostream& stream) const;
+
     EvalResult forward(const int* active_features, int count) const;
-    
+
     // Lazy evaluation methods - compute individual heads
     float compute_eval(const int* active_features, int count) const;
     float compute_tau(const int* active_features, int count) const;
@@ -38,26 +86,190 @@ public:
     float compute_rs(const int* active_features, int count) const;
     std::pair<float, float> compute_rho_and_rs(const int* active_features, int count) const;
 
+    // First layer sums (without bias) for incremental evaluation. 'update_accumulator'
+    // writes 'from' plus the added rows minus the removed rows into 'to'.
+    void refresh_accumulator(const int* active_features, int count, int32_t* acc) const;
+    void update_accumulator(const int32_t* from, int32_t* to,
+                            const int* added, int addCount,
+                            const int* removed, int removeCount) const;
+
+    // Same as forward() / compute_rho_and_rs(), but starting from first layer sums
+    EvalResult forward(const int32_t* acc) const;
+    std::pair<float, float> compute_rho_and_rs(const int32_t* acc) const;
+
+    // Evaluates 'n' positions together. Each fc2 row is loaded once per block of
+    // BatchSize positions rather than once per position.
+    void forward_batch(const int* const* active_features, const int* counts, int n, EvalResult* out) const;
+    void forward_batch(const int32_t* const* accs, int n, EvalResult* out) const;
+
+    // Times the fused output kernel against four single-head passes
+    std::string benchmark_heads(const int* active_features, int count, int iterations) const;
+
+    std::size_t get_content_hash() const;
+
+private:
+    static constexpr int HeadCount = 4;
+    static constexpr int BatchSize = 4;
+
+    void pack_heads();
+    EvalResult run_heads(const int32_t* h2) const;
+
+    // Hidden layers of 'n' positions, batched when n == BatchSize
+    void propagate(const int32_t* const* accs, int n, int32_t* const* h2) const;
+    void compute_hidden_layer(const int* active_features, int count, int32_t* h2) const;
+
+    float       eval_mean, eval_std;
+    InputLayer  fc1;
+    HiddenLayer fc2;
+    OutputLayer eval_head;
+    OutputLayer tau_head;
+    OutputLayer rho_head;
+    OutputLayer rs_head;
+
+    // The four heads packed in HeadChunk-input chunks (eval, tau, rho, rs), built at load time
+    alignas(64) std::array<int16_t, HeadCount * MaxL2Size> heads;
+    int32_t                                                heads_bias[HeadCount];
+
+    // HNN5 only: fc2 as int8 in the input-group order of the NNUE affine
+    // transform, see second_layer_int8(). The heads keep their int16 storage.
+    bool  quantized;
+    float fc2_scale;
+    float heads_scale[HeadCount];
+    alignas(64) std::array<int8_t, MaxL2Size * MaxL1Size> fc2_weights8;
+};
+
+// Stack of first layer sums kept by each search thread next to the NNUE
+// accumulator stack. do_move() only records the DirtyPiece of the move; the
+// sums are brought up to date from the nearest computed ancestor the first
+// time a query needs them, so nodes that never ask HARENN pay nothing.
+class AccumulatorStack {
+public:
+    static constexpr std::size_t MaxSize = MAX_PLY + 1;
+
+    void reset() noexcept {
+        size = 1;
+        states[0].computed = false;
+    }
+
+    void push(const DirtyPiece& dp) noexcept {
+        assert(size < MaxSize);
+        states[size].dirty    = dp;
+        states[size].computed = false;
+        ++size;
+    }
+
+    void pop() noexcept {
+        assert(size > 1);
+        --size;
+    }
+
+    // Returns the first layer sums of 'pos', which must be the position
+    // reached by the moves pushed since the last reset().
+    const int32_t* evaluate(const Position& pos, const Network& net) noexcept;
+
 private:
-    float eval_mean, eval_std;
-    Layer fc1;
-    Layer fc2;
-    Layer eval_head;
-    Layer tau_head;
-    Layer rho_head;
-    Layer rs_head;
+    // Past this many pending moves a refresh is cheaper than replaying them
+    static constexpr std::size_t MaxReplay = 8;
+
+    struct alignas(64) State {
+        DirtyPiece dirty;
+        bool       computed;
+        alignas(64) int32_t sums[MaxL1Size];
+    };
+
+    std::array<State, MaxSize> states;
+    std::size_t                size = 1;
 };
 
+// Per-thread direct-mapped cache of model outputs keyed by position key. Sibling
+// moves at a node query the same parent position, and PV nodes are revisited on
+// every iteration, so most search queries can be answered from here.
+class ResultCache {
+public:
+    static constexpr std::size_t Size = 4096;
+
+    bool probe(Key key, EvalResult& result) noexcept {
+        const Entry& e = entries[key & (Size - 1)];
+        if (e.key == key) {
+            ++hits;
+            result = e.result;
+            return true;
+        }
+        ++misses;
+        return false;
+    }
+
+    void store(Key key, const EvalResult& result) noexcept {
+        entries[key & (Size - 1)] = {key, result};
+    }
+
+    void clear() noexcept {
+        entries.fill({});
+        hits = misses = 0;
+    }
+
+    uint64_t hits = 0, misses = 0;
+
+private:
+    struct Entry {
+        Key        key;
+        EvalResult result;
+    };
+
+    std::array<Entry, Size> entries;
+};
+
+// The HARENN model of one engine, replicated per NUMA node like the NNUE
+// networks. Each Engine owns one and hands it to its search threads through
+// the SharedState, so engines of the same process load and query their own.
 class GuidanceProvider {
 public:
-    static void init();
-    static EvalResult query(const Position& pos, NumaReplicatedAccessToken numaToken);
-    static std::pair<float, float> query_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken);
-    static bool is_model_loaded();
+    explicit GuidanceProvider(NumaReplicationContext& numaContext);
+
+    // Loads 'file', trying the embedded default model first, then the working
+    // directory, then 'rootDirectory'. The model is parsed into a Network and
+    // copied into the system-wide replica, so processes loading the same model
+    // share one copy of the weights, but none of them reads the file in place.
+    void load(const std::string& rootDirectory, const std::string& file);
+    void ensure_replicated(NumaReplicatedAccessToken numaToken) const;
+    EvalResult query(const Position& pos, NumaReplicatedAccessToken numaToken) const;
+    std::pair<float, float> query_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken) const;
+
+    // Evaluates the positions after each of 'moves', which must be legal in
+    // 'pos'. The first layer sums of every child are derived from the parent's.
+    std::vector<EvalResult> query_children(const Position& pos, const std::vector<Move>& moves, NumaReplicatedAccessToken numaToken) const;
+
+    // Incremental variants for use inside the search
+    EvalResult query(const Position& pos, AccumulatorStack& acc, NumaReplicatedAccessToken numaToken) const;
+    std::pair<float, float> query_rho_and_rs(const Position& pos, AccumulatorStack& acc, NumaReplicatedAccessToken numaToken) const;
+
+    bool is_model_loaded() const { return modelLoaded; }
+
+    // Quantizes the loaded HNN4 model, writes the HNN5 result to 'file' and
+    // reports its error against the HNN4 outputs on 'fens' and their children
+    std::string quantize(const std::string& file, const std::vector<std::string>& fens) const;
+
+    // Microbenchmark of the output heads on the given position
+    std::string benchmark(const Position& pos, int iterations) const;
+
+    // Times each inference path over 'fens', with the weights cache-resident
+    // and after evicting the caches before every query
+    std::string bench(const std::vector<std::string>& fens, int iterations) const;
+
+private:
+    LazyNumaReplicatedSystemWide<Network> networks;
+    bool                                  modelLoaded = false;
 };
 
 } // namespace HARENN
 
 } // namespace Stockfish
 
+template<>
+struct std::hash<Stockfish::HARENN::Network> {
+    std::size_t operator()(const Stockfish::HARENN::Network& network) const noexcept {
+        return network.get_content_hash();
+    }
+};
+
 #endif // HARENN_H_INCLUDED
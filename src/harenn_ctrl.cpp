@@ -12,35 +12,33 @@ namespace Stockfish {
 
 namespace HARENN {
 
-namespace {
-    // Tunable parameters, refreshed from UCI options at start of search
-    float tm_center      = 0.35f;
-    float tm_slope       = 14.3f;
-    float tm_range_min   = 95.0f;
-    float tm_range_max   = 105.0f;
-    float ext_threshold_white = 0.8228f;
-    float ext_threshold_black = 0.7060f;
+ControllerParams Controller::read_params(const OptionsMap& options) {
+    ControllerParams params;
+    params.tm_center      = options["HARE TM Center"] * 0.01f;
+    params.tm_slope       = options["HARE TM Slope"] * 0.1f;
+    params.tm_range_min   = (float)(int)options["HARE TM Range Min"];
+    params.tm_range_max   = (float)(int)options["HARE TM Range Max"];
+    params.ext_threshold_white = options["HARE Ext Threshold White"] * 0.001f;
+    params.ext_threshold_black = options["HARE Ext Threshold Black"] * 0.001f;
+    return params;
 }
 
-void Controller::init() {
-    GuidanceProvider::init();
+EvalResult Controller::get_analysis(const GuidanceProvider& guidance, const Position& pos, NumaReplicatedAccessToken numaToken) {
+    return guidance.query(pos, numaToken);
 }
 
-void Controller::refresh_params(const OptionsMap& options) {
-    tm_center      = options["HARE TM Center"] * 0.01f;
-    tm_slope       = options["HARE TM Slope"] * 0.1f;
-    tm_range_min   = (float)(int)options["HARE TM Range Min"];
-    tm_range_max   = (float)(int)options["HARE TM Range Max"];
-    ext_threshold_white = options["HARE Ext Threshold White"] * 0.001f;
-    ext_threshold_black = options["HARE Ext Threshold Black"] * 0.001f;
-}
+EvalResult Controller::get_analysis(const GuidanceProvider& guidance, const Position& pos, AccumulatorStack& acc, ResultCache& cache, NumaReplicatedAccessToken numaToken) {
+    EvalResult res;
+    if (cache.probe(pos.key(), res))
+        return res;
 
-EvalResult Controller::get_analysis(const Position& pos, NumaReplicatedAccessToken numaToken) {
-    return GuidanceProvider::query(pos, numaToken);
+    res = guidance.query(pos, acc, numaToken);
+    cache.store(pos.key(), res);
+    return res;
 }
 
-std::pair<float, float> Controller::get_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken) {
-    return GuidanceProvider::query_rho_and_rs(pos, numaToken);
+std::pair<float, float> Controller::get_rho_and_rs(const GuidanceProvider& guidance, const Position& pos, NumaReplicatedAccessToken numaToken) {
+    return guidance.query_rho_and_rs(pos, numaToken);
 }
 
 int Controller::get_smart_reduction(const Position& pos, Depth depth, Move m, int moveCount, int baseR, Value staticEval, Value rootScore) {
@@ -73,23 +71,29 @@ int Controller::get_qs_tactical_adjustment(const Position& pos, int standPat) {
     return standPat;
 }
 
-int Controller::get_search_extension(const Position& pos, Move m, Depth depth, bool givesCheck, NumaReplicatedAccessToken numaToken) {
-    if (!GuidanceProvider::is_model_loaded()) {
+int Controller::get_search_extension(const GuidanceProvider& guidance, const ControllerParams& params, const Position& pos, AccumulatorStack& acc, ResultCache& cache, ExtensionStats& stats, Move m, Depth depth, bool givesCheck, NumaReplicatedAccessToken numaToken) {
+    if (!guidance.is_model_loaded()) {
+        ++stats.skipped;
         return 0;
     }
 
     // Only apply to reasonable search depths to minimize evaluation overhead
     if (depth < 6) {
+        ++stats.skipped;
         return 0;
     }
 
     // Check if the move is a check or a capture first to avoid query overhead on non-tactical moves
     if (!givesCheck && !pos.capture_stage(m)) {
+        ++stats.skipped;
         return 0;
     }
 
-    // Query the HARENN model
-    EvalResult res = get_analysis(pos, numaToken);
+    ++stats.queried;
+
+    // Query the HARENN model, reusing the incrementally updated first layer.
+    // Sibling checks share the parent position, so only the first one misses.
+    EvalResult res = get_analysis(guidance, pos, acc, cache, numaToken);
 
     // If Horizon Risk (rho) or Resolution Score (rs) is very high,
     // indicating high tactical volatility/danger, and this is a check
@@ -97,21 +101,22 @@ int Controller::get_search_extension(const Position& pos, Move m, Depth depth, b
     // For Black (side to move), we lower the threshold slightly (rho > 0.70f or rs > 0.70f)
     // to search deeper in critical defensive situations.
     const bool isBlack = (pos.side_to_move() == BLACK);
-    const float threshold = isBlack ? ext_threshold_black : ext_threshold_white;
+    const float threshold = isBlack ? params.ext_threshold_black : params.ext_threshold_white;
     if (res.rho > threshold || res.rs < (1.0f - threshold)) {
+        ++stats.extended;
         return 1;
     }
 
     return 0;
 }
 
-int Controller::get_time_multiplier(const Position& pos) {
-    if (!GuidanceProvider::is_model_loaded()) return 100;
+int Controller::get_time_multiplier(const GuidanceProvider& guidance, const ControllerParams& params, const Position& pos, NumaReplicatedAccessToken numaToken) {
+    if (!guidance.is_model_loaded()) return 100;
 
-    EvalResult res = get_analysis(pos, NumaReplicatedAccessToken(0));
+    EvalResult res = get_analysis(guidance, pos, numaToken);
 
-    float mult = 100.0f + (res.tau - tm_center) * tm_slope;
-    return int(std::clamp(mult, tm_range_min, tm_range_max));
+    float mult = 100.0f + (res.tau - params.tm_center) * params.tm_slope;
+    return int(std::clamp(mult, params.tm_range_min, params.tm_range_max));
 }
 
 } // namespace HARENN
@@ -5,6 +5,7 @@
 #include "position.h"
 #include "harenn.h"
 
+#include <cstdint>
 #include <string>
 
 namespace Stockfish {
@@ -13,16 +14,36 @@ class OptionsMap;
 
 namespace HARENN {
 
+// Per-thread outcomes of the search extension at PV nodes, summed over the
+// threads by ThreadPool::harenn_extension_stats(). A move is skipped when the
+// search filters it out (not a check, or depth outside 6 to 12) or when
+// get_search_extension() returns before a query.
+struct ExtensionStats {
+    uint64_t queried  = 0;  // calls that asked the model
+    uint64_t extended = 0;  // queried calls that extended
+    uint64_t skipped  = 0;  // moves filtered out before a query
+
+    void clear() noexcept { *this = {}; }
+};
+
+// Tunable parameters, read from the UCI options at the start of a search
+struct ControllerParams {
+    float tm_center           = 0.35f;
+    float tm_slope            = 14.3f;
+    float tm_range_min        = 95.0f;
+    float tm_range_max        = 105.0f;
+    float ext_threshold_white = 0.8228f;
+    float ext_threshold_black = 0.7060f;
+};
+
 class Controller {
 public:
-    static void init();
-
-    // Load tunable parameters from UCI options (call at start of search)
-    static void refresh_params(const OptionsMap& options);
+    static ControllerParams read_params(const OptionsMap& options);
     
     // Phân tích AI tích hợp (Tau, Rho, Rs, Eval)
-    static EvalResult get_analysis(const Position& pos, NumaReplicatedAccessToken numaToken);
-    static std::pair<float, float> get_rho_and_rs(const Position& pos, NumaReplicatedAccessToken numaToken);
+    static EvalResult get_analysis(const GuidanceProvider& guidance, const Position& pos, NumaReplicatedAccessToken numaToken);
+    static EvalResult get_analysis(const GuidanceProvider& guidance, const Position& pos, AccumulatorStack& acc, ResultCache& cache, NumaReplicatedAccessToken numaToken);
+    static std::pair<float, float> get_rho_and_rs(const GuidanceProvider& guidance, const Position& pos, NumaReplicatedAccessToken numaToken);
 
     // Điều phối cắt tỉa (LMR) dựa trên AI
     static int get_smart_reduction(const Position& pos, Depth depth, Move m, int moveCount, int baseR, Value staticEval, Value rootScore);
@@ -34,13 +55,13 @@ public:
     static int get_move_bonus(const Position& pos, Move m);
 
     // AI-based selective depth extension
-    static int get_search_extension(const Position& pos, Move m, Depth depth, bool givesCheck, NumaReplicatedAccessToken numaToken);
+    static int get_search_extension(const GuidanceProvider& guidance, const ControllerParams& params, const Position& pos, AccumulatorStack& acc, ResultCache& cache, ExtensionStats& stats, Move m, Depth depth, bool givesCheck, NumaReplicatedAccessToken numaToken);
 
     // Điều phối Quiescence Search (Đồng thuận AI-Engine)
     static int get_qs_tactical_adjustment(const Position& pos, int standPat);
 
     // Điều phối thời gian (Time management)
-    static int get_time_multiplier(const Position& pos);
+    static int get_time_multiplier(const GuidanceProvider& guidance, const ControllerParams& params, const Position& pos, NumaReplicatedAccessToken numaToken);
 };
 
 } // namespace HARENN
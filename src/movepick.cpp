@@ -91,7 +91,8 @@ MovePicker::MovePicker(const Position&              p,
                        const PieceToHistory**       ch,
                        const SharedHistories*       sh,
                        int                          pl,
-                       bool                         useDeeOrdering) :
+                       bool                         useDeeOrdering,
+                       DEE::Stats*                  ds) :
     pos(p),
     mainHistory(mh),
     lowPlyHistory(lph),
@@ -101,7 +102,9 @@ MovePicker::MovePicker(const Position&              p,
     ttMove(ttm),
     depth(d),
     ply(pl),
-    useDeeCaptureOrdering(useDeeOrdering) {
+    useDeeCaptureOrdering(useDeeOrdering),
+    deeStats(ds),
+    captureContext(p) {
 
     if (pos.checkers())
         stage = EVASION_TT + !(ttm && pos.pseudo_legal(ttm));
@@ -116,7 +119,8 @@ MovePicker::MovePicker(const Position& p, Move ttm, int th, const CapturePieceTo
     pos(p),
     captureHistory(cph),
     ttMove(ttm),
-    threshold(th) {
+    threshold(th),
+    captureContext(p) {
     assert(!pos.checkers());
 
     stage = PROBCUT_TT + !(ttm && pos.capture_stage(ttm) && pos.pseudo_legal(ttm));
@@ -163,7 +167,10 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
             // DEE Micro-Ordering: Subtle tie-breaker for captures
             if (useDeeCaptureOrdering && depth >= 6)
             {
-                const int dee = int(DEE::Evaluator::adjusted_see(pos, m));
+                const uint64_t start = deeStats ? DEE::timestamp() : 0;
+                const int      dee   = int(captureContext.adjusted_see(m));
+                if (deeStats)
+                    deeStats->add(DEE::Stats::CaptureOrdering, Value(dee), DEE::timestamp() - start);
                 if (dee > 0)
                     m.value += std::min(40, dee); // V17 stable weight
             }
@@ -247,7 +254,7 @@ top:
 
     case GOOD_CAPTURE :
         if (select([&]() {
-                if (pos.see_ge(*cur, -cur->value / 18))
+                if (captureContext.see_ge(*cur, -cur->value / 18))
                     return true;
                 std::swap(*endBadCaptures++, *cur);
                 return false;
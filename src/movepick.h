@@ -19,6 +19,7 @@
 #ifndef MOVEPICK_H_INCLUDED
 #define MOVEPICK_H_INCLUDED
 
+#include "dee.h"
 #include "history.h"
 #include "movegen.h"
 #include "types.h"
@@ -47,11 +48,14 @@ class MovePicker {
                const PieceToHistory**,
                const SharedHistories*,
                int,
-               bool = false);
+               bool         = false,
+               DEE::Stats*  = nullptr);
     MovePicker(const Position&, Move, int, const CapturePieceToHistory*);
     Move next_move();
     void skip_quiet_moves();
 
+    DEE::CaptureContext& capture_context() { return captureContext; }
+
    private:
     template<typename Pred>
     Move select(Pred);
@@ -74,6 +78,8 @@ class MovePicker {
     int                          ply;
     bool                         skipQuiets = false;
     bool                         useDeeCaptureOrdering = false;
+    DEE::Stats*                  deeStats              = nullptr;
+    DEE::CaptureContext          captureContext;
     ExtMove                      moves[MAX_MOVES];
 };
 
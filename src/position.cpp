@@ -346,6 +346,8 @@ void Position::set_state() const {
     st->pawnKey                                   = Zobrist::noPawns;
     st->nonPawnMaterial[WHITE] = st->nonPawnMaterial[BLACK] = VALUE_ZERO;
     st->checkersBB = attackers_to(square<KING>(sideToMove)) & pieces(~sideToMove);
+    st->attacks[WHITE] = st->attacks[BLACK] = 0;
+    st->tension                             = -1;
 
     set_check_info();
 
@@ -718,6 +720,9 @@ void Position::do_move(Move                      m,
     newSt.previous = st;
     st             = &newSt;
 
+    st->attacks[WHITE] = st->attacks[BLACK] = 0;
+    st->tension                             = -1;
+
     // Increment ply counters. In particular, rule50 will be reset to zero later on
     // in case of a capture or a pawn move.
     ++gamePly;
@@ -1289,6 +1294,29 @@ void Position::undo_null_move() {
 }
 
 
+// Returns the squares attacked by color 'c'. Both maps are computed together
+// the first time either is asked for at a node and kept in the StateInfo. A
+// side always attacks the squares around its king, so an empty map means not
+// computed yet. A null move keeps the maps, the board being the same.
+Bitboard Position::attack_map(Color c) const {
+
+    if (!st->attacks[WHITE])
+        for (Color col : {WHITE, BLACK})
+        {
+            Bitboard b = attacks_by<PAWN>(col) | attacks_by<KNIGHT>(col) | attacks_by<KING>(col);
+
+            for (Bitboard s = pieces(col, BISHOP, QUEEN); s;)
+                b |= attacks_bb<BISHOP>(pop_lsb(s), pieces());
+            for (Bitboard s = pieces(col, ROOK, QUEEN); s;)
+                b |= attacks_bb<ROOK>(pop_lsb(s), pieces());
+
+            st->attacks[col] = b;
+        }
+
+    return st->attacks[c];
+}
+
+
 // Tests if the SEE (Static Exchange Evaluation)
 // value of move is greater or equal to the given threshold. We'll use an
 // algorithm similar to alpha-beta pruning with a null window.
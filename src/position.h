@@ -61,7 +61,11 @@ struct StateInfo {
     Bitboard   checkSquares[PIECE_TYPE_NB];
     Piece      capturedPiece;
     int        repetition;
-    int        tension;
+
+    // Computed on first use at each node, see Position::attack_map() and
+    // DEE::Evaluator::tension_score(). Empty / -1 until then.
+    Bitboard attacks[COLOR_NB];
+    int      tension;
 };
 
 
@@ -124,6 +128,7 @@ class Position {
     void     update_slider_blockers(Color c) const;
     template<PieceType Pt>
     Bitboard attacks_by(Color c) const;
+    Bitboard attack_map(Color c) const;
 
     // Properties of moves
     bool  legal(Move m) const;
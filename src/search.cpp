@@ -32,6 +32,7 @@
 #include "uci.h"
 #include "ucioption.h"
 #include "dee.h"
+#include "dqrs.h"
 #include "harenn.h"
 #include "harenn_ctrl.h"
 
@@ -143,29 +144,34 @@ Search::Worker::Worker(const SharedState&              sharedState,
     threads(sharedState.threads),
     tt(sharedState.tt),
     networks(sharedState.networks),
+    harenn(sharedState.harenn),
     refreshTable(networks[token]) {
+    searchStop = &threads.stop;
     clear();
 }
 
 void Search::Worker::ensure_network_replicated() {
     (void) (networks[numaAccessToken]);
+    harenn.ensure_replicated(numaAccessToken);
 }
 
 void Search::Worker::start_searching() {
     accumulatorStack.reset();
+    harennAccumulators.reset();
     if (!is_mainthread()) { iterative_deepening(); return; }
     main_manager()->tm.init(limits, rootPos.side_to_move(), rootPos.game_ply(), options,
-                            main_manager()->originalTimeAdjust, rootPos);
-    tt.new_search();
+                            main_manager()->originalTimeAdjust, rootPos, harenn, numaAccessToken);
+    threads.start_timer(limits); tt.new_search();
     if (rootMoves.empty()) {
         rootMoves.emplace_back(Move::none());
         main_manager()->updates.onUpdateNoMoves({0, {rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW, rootPos}});
     } else {
         threads.start_searching(); iterative_deepening();
     }
-    while (!threads.stop && (main_manager()->ponder || limits.infinite)) {}
+    // While pondering or in infinite mode the search must not end by itself: sleep until 'stop' or 'ponderhit'
+    threads.wait_for_stop_signal([&] { return threads.stop || !(main_manager()->ponder || limits.infinite); });
     threads.stop = true;
-    threads.wait_for_search_finished();
+    threads.wait_for_search_finished(); threads.stop_timer();
     if (limits.npmsec) main_manager()->tm.advance_nodes_time(threads.nodes_searched() - limits.inc[rootPos.side_to_move()]);
     Worker* bestThread = this;
     Skill skill = Skill(options["Skill Level"], options["UCI_LimitStrength"] ? int(options["UCI_Elo"]) : 0);
@@ -181,16 +187,49 @@ void Search::Worker::start_searching() {
     main_manager()->updates.onBestmove(bestmove, ponder);
 }
 
+Search::AnalysisResult Search::Worker::analyze(size_t index, const std::string& fen, const LimitsType& searchLimits) {
+    limits = searchLimits; limits.startTime = now(); nodes = tbHits = bestMoveChanges = 0; nmpMinPly = 0; rootDepth = completedDepth = 0;
+    rootPos.set(fen, options["UCI_Chess960"], &rootState); rootMoves.clear();
+    for (const auto& m : MoveList<LEGAL>(rootPos)) rootMoves.emplace_back(m);
+    tbConfig = Tablebases::rank_root_moves(options, rootPos, rootMoves);
+    AnalysisResult result{index, rootPos.fen(), 0, 0, {rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW, rootPos}, 0, ""};
+    if (rootMoves.empty()) return result;
+    accumulatorStack.reset(); harennAccumulators.reset();
+    searchingAlone = true; searchStop = &aloneStop; aloneStop = false; aloneCalls = 0;
+    iterative_deepening();
+    searchingAlone = false; searchStop = &threads.stop;
+    // Reported as pv() would report the first line
+    const RootMove& rm = rootMoves[0]; Value v = rm.score != -VALUE_INFINITE ? rm.uciScore : rm.previousScore; if (v == -VALUE_INFINITE) v = VALUE_ZERO;
+    if (tbConfig.rootInTB && std::abs(v) <= VALUE_TB) v = rm.tbScore;
+    result.depth = completedDepth; result.selDepth = rm.selDepth; result.score = {v, rootPos}; result.nodes = nodes;
+    for (Move m : rm.pv) result.pv += (result.pv.empty() ? "" : " ") + UCIEngine::move(m, rootPos.is_chess960());
+    return result;
+}
+
+// The nodes and movetime limits of analyze(), polled like check_time() does. A
+// 'stop' of the whole pool ends the search at once.
+void Search::Worker::check_alone_limits() {
+    if (--aloneCalls > 0) return;
+    aloneCalls = limits.nodes ? std::min(512, int(limits.nodes / 1024)) : 512;
+    if (threads.stop) { aloneStop = true; return; }
+    if (completedDepth >= 1 && ((limits.nodes && nodes >= limits.nodes) || (limits.movetime && now() - limits.startTime >= limits.movetime))) aloneStop = true;
+}
+
 void Search::Worker::iterative_deepening() {
     useDEE = options["Use DEE/HARENN"];
     useDEECaptureOrdering = options["Use DEE Capture Ordering"];
     useDEECaptureLMR = options["Use DEE Capture LMR"];
     useDEECapturePruning = options["Use DEE Capture Pruning"];
+    useDQRSExchange = options["Use DQRS Exchange Solver"];
+    useTrajectoryStop = options["Use DQRS Trajectory Stop"];
+    auditTrajectoryStop = options["DQRS Trajectory Audit"];
+    ttCounters = options["TT Stats"] ? &ttStats : nullptr;
+    deeCounters = options["DEE Stats"] ? &deeStats : nullptr;
     useHAREAspiration = options["Use HARE Aspiration"];
     useHAREReduction = options["Use HARE Reduction"];
-    HARENN::Controller::refresh_params(options);
+    harennParams = HARENN::Controller::read_params(options);
 
-    SearchManager* mainThread = (is_mainthread() ? main_manager() : nullptr);
+    SearchManager* mainThread = (is_mainthread() && !searchingAlone ? main_manager() : nullptr);
     Move pv[MAX_PLY + 1];
     Depth lastBestMoveDepth = 0; Value lastBestScore = -VALUE_INFINITE;
     auto lastBestPV = std::vector{Move::none()};
@@ -219,7 +258,7 @@ void Search::Worker::iterative_deepening() {
     for (Color c : {WHITE, BLACK}) for (int i = 0; i < UINT_16_HISTORY_SIZE; i++)
         mainHistory[c][i] = (mainHistory[c][i] - mainHistoryDefault) * 3 / 4 + mainHistoryDefault;
 
-    while (++rootDepth < MAX_PLY && !threads.stop && !(limits.depth && mainThread && rootDepth > limits.depth)) {
+    while (++rootDepth < MAX_PLY && !*searchStop && !(limits.depth && (mainThread || searchingAlone) && rootDepth > limits.depth)) {
         if (mainThread) totBestMoveChanges /= 2;
         for (RootMove& rm : rootMoves) rm.previousScore = rm.score;
         size_t pvFirst = 0; pvLast = 0;
@@ -244,7 +283,7 @@ void Search::Worker::iterative_deepening() {
                 rootDelta = beta - alpha;
                 bestValue = search<Root>(rootPos, ss, alpha, beta, adjustedDepth, false);
                 std::stable_sort(rootMoves.begin() + pvIdx, rootMoves.begin() + pvLast);
-                if (threads.stop) break;
+                if (*searchStop) break;
                 if (mainThread && multiPV == 1 && (bestValue <= alpha || bestValue >= beta) && nodes > 10000000)
                     main_manager()->pv(*this, threads, tt, rootDepth);
                 if (bestValue <= alpha) { beta = alpha; alpha = std::max(bestValue - delta, -VALUE_INFINITE); failedHighCnt = 0; if (mainThread) mainThread->stopOnPonderhit = false; }
@@ -255,9 +294,10 @@ void Search::Worker::iterative_deepening() {
             std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
             if (mainThread && (threads.stop || pvIdx + 1 == multiPV || nodes > 10000000) && !(threads.abortedSearch && is_loss(rootMoves[0].uciScore)))
                 main_manager()->pv(*this, threads, tt, rootDepth);
-            if (threads.stop) break;
+            if (*searchStop) break;
         }
-        if (!threads.stop) completedDepth = rootDepth;
+        if (!*searchStop) completedDepth = rootDepth;
+        if (mainThread && completedDepth >= 1 && !mainThread->depthCompleted) { mainThread->depthCompleted = true; threads.notify_stop_signal(); }
         if (threads.abortedSearch && rootMoves[0].score != -VALUE_INFINITE && is_loss(rootMoves[0].score)) {
             Utility::move_to_front(rootMoves, [&lastBestPV = std::as_const(lastBestPV)](const auto& rm) { return rm == lastBestPV[0]; });
             rootMoves[0].pv = lastBestPV; rootMoves[0].score = rootMoves[0].uciScore = lastBestScore;
@@ -299,6 +339,7 @@ void Search::Worker::do_move(Position& pos, const Move move, StateInfo& st, cons
     nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     auto [dirtyPiece, dirtyThreats] = accumulatorStack.push();
     pos.do_move(move, st, givesCheck, dirtyPiece, dirtyThreats, &tt, &sharedHistory);
+    harennAccumulators.push(dirtyPiece);
     if (ss != nullptr) {
         ss->currentMove = move;
         ss->continuationHistory = &continuationHistory[ss->inCheck][capture][dirtyPiece.pc][move.to_sq()];
@@ -311,7 +352,7 @@ void Search::Worker::do_null_move(Position& pos, StateInfo& st, Stack* const ss)
     ss->continuationHistory = &continuationHistory[0][0][NO_PIECE][0];
     ss->continuationCorrectionHistory = &continuationCorrectionHistory[NO_PIECE][0];
 }
-void Search::Worker::undo_move(Position& pos, const Move move) { pos.undo_move(move); accumulatorStack.pop(); }
+void Search::Worker::undo_move(Position& pos, const Move move) { pos.undo_move(move); accumulatorStack.pop(); harennAccumulators.pop(); }
 void Search::Worker::undo_null_move(Position& pos) { pos.undo_null_move(); }
 
 void Search::Worker::clear() {
@@ -323,6 +364,11 @@ void Search::Worker::clear() {
     for (bool inCheck : {false, true}) for (StatsType c : {NoCaptures, Captures}) for (auto& to : continuationHistory[inCheck][c]) for (auto& h : to) h.fill(-529);
     for (size_t i = 1; i < reductions.size(); ++i) reductions[i] = int(2747 / 128.0 * std::log(i));
     refreshTable.clear(networks[numaAccessToken]);
+    harennCache.clear();
+    harennExtensionStats.clear();
+    trajectoryStats.clear();
+    deeStats.clear();
+    ttStats.clear();
 }
 
 template<NodeType nodeType>
@@ -333,15 +379,16 @@ Value Search::Worker::search(Position& pos, Stack* ss, Value alpha, Value beta,
     if (!rootNode && alpha < VALUE_DRAW && pos.upcoming_repetition(ss->ply)) { alpha = value_draw(nodes); if (alpha >= beta) return alpha; }
     Move pv[MAX_PLY + 1]; StateInfo st; Key posKey; Move move, excludedMove, bestMove; Depth extension, newDepth; Value bestValue, value, eval, maxValue, probCutBeta; bool givesCheck, improving, priorCapture, opponentWorsening, capture, ttCapture; int priorReduction; Piece movedPiece; SearchedList capturesSearched, quietsSearched;
     ss->inCheck = pos.checkers(); priorCapture = pos.captured_piece(); Color us = pos.side_to_move(); ss->moveCount = 0; bestValue = -VALUE_INFINITE; maxValue = VALUE_INFINITE;
-    if (is_mainthread()) main_manager()->check_time(*this);
+    if (searchingAlone) check_alone_limits();
+    else if (is_mainthread() && (limits.nodes || limits.npmsec)) main_manager()->check_time(*this);
     if (PvNode && selDepth < ss->ply + 1) selDepth = ss->ply + 1;
     if (!rootNode) {
-        if (threads.stop.load(std::memory_order_relaxed) || pos.is_draw(ss->ply) || ss->ply >= MAX_PLY) return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos) : value_draw(nodes);
+        if (searchStop->load(std::memory_order_relaxed) || pos.is_draw(ss->ply) || ss->ply >= MAX_PLY) return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos) : value_draw(nodes);
         alpha = std::max(mated_in(ss->ply), alpha); beta = std::min(mate_in(ss->ply + 1), beta); if (alpha >= beta) return alpha;
     }
     Square prevSq = ((ss - 1)->currentMove).is_ok() ? ((ss - 1)->currentMove).to_sq() : SQ_NONE;
     bestMove = Move::none(); priorReduction = (ss - 1)->reduction; (ss - 1)->reduction = 0; ss->statScore = 0; (ss + 2)->cutoffCnt = 0;
-    excludedMove = ss->excludedMove; posKey = pos.key(); auto [ttHit, ttData, ttWriter] = tt.probe(posKey);
+    excludedMove = ss->excludedMove; posKey = pos.key(); auto [ttHit, ttData, ttWriter] = tt.probe(posKey, ttCounters, TTStats::SearchProbe);
     ss->ttHit = ttHit; ttData.move = rootNode ? rootMoves[pvIdx].pv[0] : ttHit ? ttData.move : Move::none();
     ttData.value = ttHit ? value_from_tt(ttData.value, ss->ply, pos.rule50_count()) : VALUE_NONE;
     ss->ttPv = excludedMove ? ss->ttPv : PvNode || (ttHit && ttData.is_pv); ttCapture = ttData.move && pos.capture_stage(ttData.move);
@@ -356,6 +403,7 @@ Value Search::Worker::search(Position& pos, Stack* ss, Value alpha, Value beta,
         unadjustedStaticEval = evaluate(pos); ss->staticEval = eval = to_corrected_static_eval(unadjustedStaticEval, correctionValue);
         ttWriter.write(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_UNSEARCHED, Move::none(), unadjustedStaticEval, tt.generation());
     }
+    if (useTrajectoryStop) trajectory.record(ss->ply, ss->inCheck ? VALUE_NONE : ss->ply % 2 ? -ss->staticEval : ss->staticEval);
     improving = ss->staticEval > (ss - 2)->staticEval; opponentWorsening = ss->staticEval > -(ss - 1)->staticEval;
     if (priorReduction >= 3 && !opponentWorsening) depth++; if (priorReduction >= 2 && depth >= 2 && ss->staticEval + (ss - 1)->staticEval > 173) depth--;
     if (!PvNode && !excludedMove && ttData.depth > depth - (ttData.value <= beta) && is_valid(ttData.value) && (ttData.bound & (ttData.value >= beta ? BOUND_LOWER : BOUND_UPPER)) && (cutNode == (ttData.value >= beta) || depth > 5)) {
@@ -425,22 +473,25 @@ moves_loop:
     probCutBeta = beta + 418;
     if ((ttData.bound & BOUND_LOWER) && ttData.depth >= depth - 4 && ttData.value >= probCutBeta && !is_decisive(beta) && is_valid(ttData.value) && !is_decisive(ttData.value)) return probCutBeta;
     const PieceToHistory* contHist[] = { (ss - 1)->continuationHistory, (ss - 2)->continuationHistory, (ss - 3)->continuationHistory, (ss - 4)->continuationHistory, (ss - 5)->continuationHistory, (ss - 6)->continuationHistory};
-    MovePicker mp(pos, ttData.move, depth, &mainHistory, &lowPlyHistory, &captureHistory, contHist, &sharedHistory, ss->ply, useDEE && useDEECaptureOrdering);
+    MovePicker mp(pos, ttData.move, depth, &mainHistory, &lowPlyHistory, &captureHistory, contHist, &sharedHistory, ss->ply, useDEE && useDEECaptureOrdering, deeCounters);
     value = bestValue; int moveCount = 0;
     while ((move = mp.next_move()) != Move::none()) {
         if (move == excludedMove || !pos.legal(move)) continue;
         if (rootNode && !std::count(rootMoves.begin() + pvIdx, rootMoves.begin() + pvLast, move)) continue;
         ss->moveCount = ++moveCount;
-        if (rootNode && is_mainthread() && nodes > 10000000) main_manager()->updates.onIter({depth, UCIEngine::move(move, pos.is_chess960()), moveCount + pvIdx});
+        if (rootNode && is_mainthread() && !searchingAlone && nodes > 10000000) main_manager()->updates.onIter({depth, UCIEngine::move(move, pos.is_chess960()), moveCount + pvIdx});
         if (PvNode) (ss + 1)->pv = nullptr;
         extension = 0; capture = pos.capture_stage(move); movedPiece = pos.moved_piece(move); givesCheck = pos.gives_check(move);
         newDepth = depth - 1; int delta = beta - alpha; Depth r = reduction(improving, depth, moveCount, delta);
-        if (useDEE && PvNode && depth >= 6 && depth <= 12 && givesCheck)
-            extension += HARENN::Controller::get_search_extension(pos, move, depth, givesCheck, numaAccessToken);
+        if (useDEE && PvNode) {
+            if (depth >= 6 && depth <= 12 && givesCheck) extension += HARENN::Controller::get_search_extension(harenn, harennParams, pos, harennAccumulators, harennCache, harennExtensionStats, move, depth, givesCheck, numaAccessToken);
+            else harennExtensionStats.skipped++;
+        }
         if (ss->ttPv) r += 946;
         if (useDEECaptureLMR && capture && depth >= 2 && moveCount > 1) {
             if (depth < 12) {
-                Value adjSee = DEE::Evaluator::adjusted_see(pos, move);
+                const uint64_t start = deeCounters ? DEE::timestamp() : 0; Value adjSee = mp.capture_context().adjusted_see(move);
+                if (deeCounters) deeCounters->add(DEE::Stats::CaptureLMR, adjSee, DEE::timestamp() - start);
                 if (adjSee < 0)
                     r += 1024;
             }
@@ -495,7 +546,7 @@ moves_loop:
             if (move == ttData.move && ((is_valid(ttData.value) && is_decisive(ttData.value) && ttData.depth > 0) || ttData.depth > 1)) newDepth = std::max(newDepth, 1);
             value = -search<PV>(pos, ss + 1, -beta, -alpha, newDepth, false);
         }
-        undo_move(pos, move); if (threads.stop.load(std::memory_order_relaxed)) return VALUE_ZERO;
+        undo_move(pos, move); if (searchStop->load(std::memory_order_relaxed)) return VALUE_ZERO;
         if (rootNode) {
             RootMove& rm = *std::find(rootMoves.begin(), rootMoves.end(), move); rm.effort += nodes - nodeCount;
             rm.averageScore = rm.averageScore != -VALUE_INFINITE ? (value + rm.averageScore) / 2 : value;
@@ -549,17 +600,31 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     bestMove = Move::none(); ss->inCheck = pos.checkers(); moveCount = 0;
     if (PvNode && selDepth < ss->ply + 1) selDepth = ss->ply + 1;
     if (pos.is_draw(ss->ply) || ss->ply >= MAX_PLY) return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos) : VALUE_DRAW;
-    posKey = pos.key(); auto [ttHit, ttData, ttWriter] = tt.probe(posKey);
+    posKey = pos.key(); auto [ttHit, ttData, ttWriter] = tt.probe(posKey, ttCounters, TTStats::QSearchProbe);
     ss->ttHit = ttHit; ttData.move = ttHit ? ttData.move : Move::none(); ttData.value = ttHit ? value_from_tt(ttData.value, ss->ply, pos.rule50_count()) : VALUE_NONE; pvHit = ttHit && ttData.is_pv;
     if (!PvNode && ttData.depth >= DEPTH_QS && is_valid(ttData.value) && (ttData.bound & (ttData.value >= beta ? BOUND_LOWER : BOUND_UPPER))) return ttData.value;
     Value unadjustedStaticEval = VALUE_NONE;
-    if (ss->inCheck) bestValue = futilityBase = -VALUE_INFINITE;
+    if (ss->inCheck) { bestValue = futilityBase = -VALUE_INFINITE; if (useTrajectoryStop && !auditingTrajectory) trajectory.record(ss->ply, VALUE_NONE); }
     else {
         const auto correctionValue = correction_value(*this, pos, ss);
         if (ss->ttHit) { unadjustedStaticEval = ttData.eval; if (!is_valid(unadjustedStaticEval)) unadjustedStaticEval = evaluate(pos); ss->staticEval = bestValue = to_corrected_static_eval(unadjustedStaticEval, correctionValue); if (is_valid(ttData.value) && !is_decisive(ttData.value) && (ttData.bound & (ttData.value > bestValue ? BOUND_LOWER : BOUND_UPPER))) bestValue = ttData.value; }
         else { unadjustedStaticEval = evaluate(pos); ss->staticEval = bestValue = to_corrected_static_eval(unadjustedStaticEval, correctionValue); }
         if (bestValue >= beta) { if (!is_decisive(bestValue)) bestValue = (bestValue + beta) / 2; if (!ss->ttHit) ttWriter.write(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER, DEPTH_UNSEARCHED, Move::none(), unadjustedStaticEval, tt.generation()); return bestValue; }
         if (bestValue > alpha) alpha = bestValue; futilityBase = ss->staticEval + 351;
+        // The trajectory works from the root side's point of view. While a stop is audited, including the re-entry at this
+        // same stack entry, nothing is recorded: no stop is taken below it, and the line above it must stay as it was
+        if (useTrajectoryStop && !auditingTrajectory) {
+            const bool flip = ss->ply % 2; trajectory.record(ss->ply, flip ? -ss->staticEval : ss->staticEval);
+            if (trajectory.should_stop(ss->ply, flip ? -beta : alpha, flip ? -alpha : beta)) {
+                const Value predicted = flip ? -trajectory.predicted_convergence() : trajectory.predicted_convergence(); trajectoryStats.stops[ss->ply]++;
+                if (auditTrajectoryStop) {
+                    const uint64_t nodesBefore = nodes; auditingTrajectory = true; const Value full = qsearch<nodeType>(pos, ss, alpha, beta); auditingTrajectory = false;
+                    const int error = std::abs(full - predicted); trajectoryStats.audited[ss->ply]++; trajectoryStats.nodesSaved[ss->ply] += nodes - nodesBefore;
+                    trajectoryStats.errorSum[ss->ply] += error; trajectoryStats.errorMax[ss->ply] = std::max(trajectoryStats.errorMax[ss->ply], error);
+                }
+                return predicted;
+            }
+        }
     }
     const PieceToHistory* contHist[] = {(ss - 1)->continuationHistory};
     Square prevSq = ((ss - 1)->currentMove).is_ok() ? ((ss - 1)->currentMove).to_sq() : SQ_NONE;
@@ -567,9 +632,13 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     while ((move = mp.next_move()) != Move::none()) {
         if (!pos.legal(move)) continue;
         givesCheck = pos.gives_check(move); capture = pos.capture_stage(move); moveCount++;
+        // With the exchange solver the SEE of the move is solved at most once for all the thresholds below
+        Value exchange = VALUE_NONE;
+        auto see_ge = [&](int threshold) { return useDQRSExchange ? DQRS::exchange_ge(pos, move, threshold, exchange) : pos.see_ge(move, threshold); };
         if (useDEECapturePruning && capture) {
-            Value adjSee = DEE::Evaluator::adjusted_see(pos, move);
-            if (DEE::Evaluator::should_prune_in_qs(pos, move, adjSee))
+            const uint64_t start = deeCounters ? DEE::timestamp() : 0; const bool prune = mp.capture_context().should_prune_in_qs(move);
+            if (deeCounters) deeCounters->add_pruning(prune, DEE::timestamp() - start);
+            if (prune)
                 continue;
         }
         if (!is_loss(bestValue)) {
@@ -577,9 +646,9 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
                 if (moveCount > 2) continue;
                 Value futilityValue = futilityBase + PieceValue[pos.piece_on(move.to_sq())];
                 if (futilityValue <= alpha) { bestValue = std::max(bestValue, futilityValue); continue; }
-                if (!pos.see_ge(move, alpha - futilityBase)) { bestValue = std::max(bestValue, std::min(alpha, futilityBase)); continue; }
+                if (!see_ge(alpha - futilityBase)) { bestValue = std::max(bestValue, std::min(alpha, futilityBase)); continue; }
             }
-            if (!capture) continue; if (!pos.see_ge(move, -80)) continue;
+            if (!capture) continue; if (!see_ge(-80)) continue;
         }
         do_move(pos, move, st, givesCheck, ss); value = -qsearch<nodeType>(pos, ss + 1, -beta, -alpha); undo_move(pos, move);
         if (value > bestValue) { bestValue = value; if (value > alpha) { bestMove = move; if (PvNode) update_pv(ss->pv, move, (ss + 1)->pv); if (value < beta) alpha = value; else break; } }
@@ -642,8 +711,7 @@ Move Skill::pick_best(const RootMoves& rootMoves, size_t multiPV) {
 
 void SearchManager::check_time(Search::Worker& worker) {
     if (--callsCnt > 0) return; callsCnt = worker.limits.nodes ? std::min(512, int(worker.limits.nodes / 1024)) : 512;
-    static TimePoint lastInfoTime = now(); TimePoint elapsed = tm.elapsed([&worker]() { return worker.threads.nodes_searched(); }); TimePoint tick = worker.limits.startTime + elapsed;
-    if (tick - lastInfoTime >= 1000) { lastInfoTime = tick; dbg_print(); }
+    TimePoint elapsed = tm.elapsed([&worker]() { return worker.threads.nodes_searched(); });
     if (ponder) return;
     if (worker.completedDepth >= 1 && ((worker.limits.use_time_management() && (elapsed > tm.maximum() || stopOnPonderhit)) || (worker.limits.movetime && elapsed >= worker.limits.movetime) || (worker.limits.nodes && worker.threads.nodes_searched() >= worker.limits.nodes)))
         worker.threads.stop = worker.threads.abortedSearch = true;
@@ -32,6 +32,10 @@
 #include <string_view>
 #include <vector>
 
+#include "dee.h"
+#include "dqrs.h"
+#include "harenn.h"
+#include "harenn_ctrl.h"
 #include "history.h"
 #include "misc.h"
 #include "nnue/network.h"
@@ -41,6 +45,7 @@
 #include "score.h"
 #include "syzygy/tbprobe.h"
 #include "timeman.h"
+#include "tt.h"
 #include "types.h"
 
 namespace Stockfish {
@@ -52,7 +57,6 @@ enum NodeType {
     Root
 };
 
-class TranspositionTable;
 class ThreadPool;
 class OptionsMap;
 
@@ -130,6 +134,17 @@ struct LimitsType {
     bool                     ponderMode;
 };
 
+// Outcome of the search of one position of ThreadPool::analyze()
+struct AnalysisResult {
+    size_t      index;  // of the position in the batch
+    std::string fen;
+    Depth       depth;
+    int         selDepth;
+    Score       score;
+    uint64_t    nodes;
+    std::string pv;  // in UCI notation, empty if there is no legal move
+};
+
 
 // The UCI stores the uci options, thread pool, and transposition table.
 // This struct is used to easily forward data to the Search::Worker class.
@@ -138,18 +153,21 @@ struct SharedState {
                 ThreadPool&                                               threadPool,
                 TranspositionTable&                                       transpositionTable,
                 std::map<NumaIndex, SharedHistories>&                     sharedHists,
-                const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& nets) :
+                const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& nets,
+                const HARENN::GuidanceProvider&                           guidance) :
         options(optionsMap),
         threads(threadPool),
         tt(transpositionTable),
         sharedHistories(sharedHists),
-        networks(nets) {}
+        networks(nets),
+        harenn(guidance) {}
 
     const OptionsMap&                                         options;
     ThreadPool&                                               threads;
     TranspositionTable&                                       tt;
     std::map<NumaIndex, SharedHistories>&                     sharedHistories;
     const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& networks;
+    const HARENN::GuidanceProvider&                           harenn;
 };
 
 class Worker;
@@ -234,6 +252,8 @@ class SearchManager: public ISearchManager {
     SearchManager(const UpdateContext& updateContext) :
         updates(updateContext) {}
 
+    // Polls the limits counted in nodes ('go nodes' and 'nodes as time' mode).
+    // Wall clock limits are watched by the ThreadPool timer instead.
     void check_time(Search::Worker& worker) override;
 
     void pv(Search::Worker&           worker,
@@ -245,12 +265,13 @@ class SearchManager: public ISearchManager {
     double                    originalTimeAdjust;
     int                       callsCnt;
     std::atomic_bool          ponder;
+    std::atomic_bool          depthCompleted;  // The timer may only stop the search once set
 
     std::array<Value, 4> iterValue;
     double               previousTimeReduction;
     Value                bestPreviousScore;
     Value                bestPreviousAverageScore;
-    bool                 stopOnPonderhit;
+    std::atomic_bool     stopOnPonderhit;
 
     size_t id;
 
@@ -282,6 +303,10 @@ class Worker {
     // It searches from the root position and outputs the "bestmove".
     void start_searching();
 
+    // Searches 'fen' on this thread only, independently of the other threads,
+    // until the depth, nodes or movetime of 'limits'
+    AnalysisResult analyze(size_t index, const std::string& fen, const LimitsType& limits);
+
     bool is_mainthread() const { return threadIdx == 0; }
 
     void ensure_network_replicated();
@@ -299,6 +324,7 @@ class Worker {
 
    private:
     void iterative_deepening();
+    void check_alone_limits();
 
     void do_move(Position& pos, const Move move, StateInfo& st, Stack* const ss);
     void
@@ -342,6 +368,13 @@ class Worker {
     Depth     rootDepth, completedDepth;
     Value     rootDelta;
 
+    // The flag the search stops on: threads.stop, or aloneStop while the
+    // worker searches alone in analyze() with its own limits
+    std::atomic_bool* searchStop;
+    std::atomic_bool  aloneStop;
+    bool              searchingAlone = false;
+    int               aloneCalls;
+
     size_t                    threadIdx, numaThreadIdx, numaTotal;
     NumaReplicatedAccessToken numaAccessToken;
 
@@ -357,12 +390,16 @@ class Worker {
     ThreadPool&                                               threads;
     TranspositionTable&                                       tt;
     const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& networks;
+    const HARENN::GuidanceProvider&                           harenn;
 
     // Cached option flags for hot search paths
     bool useDEE = true;
     bool useDEECaptureOrdering = true;
     bool useDEECaptureLMR = false;
     bool useDEECapturePruning = false;
+    bool useDQRSExchange = false;
+    bool useTrajectoryStop = false;
+    bool auditTrajectoryStop = false;
     bool useHAREAspiration = true;
     bool useHAREReduction = true;
 
@@ -370,6 +407,25 @@ class Worker {
     Eval::NNUE::AccumulatorStack  accumulatorStack;
     Eval::NNUE::AccumulatorCaches refreshTable;
 
+    // Used by HARENN, follows the same moves as accumulatorStack
+    HARENN::AccumulatorStack harennAccumulators;
+    HARENN::ResultCache      harennCache;
+    HARENN::ExtensionStats   harennExtensionStats;
+    HARENN::ControllerParams harennParams;
+
+    // Counters of the DEE hooks, only kept with the 'DEE Stats' option
+    DEE::Stats  deeStats;
+    DEE::Stats* deeCounters = nullptr;
+
+    // Used by the DQRS trajectory stop in qsearch, see DQRS::TrajectoryPredictor
+    DQRS::TrajectoryPredictor trajectory;
+    DQRS::TrajectoryStats     trajectoryStats;
+    bool                      auditingTrajectory = false;
+
+    // Counters of the TT, only kept with the 'TT Stats' option
+    TTStats  ttStats;
+    TTStats* ttCounters = nullptr;
+
     friend class Stockfish::ThreadPool;
     friend class SearchManager;
 };
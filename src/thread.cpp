@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <deque>
 #include <map>
 #include <memory>
@@ -144,6 +145,169 @@ Search::SearchManager* ThreadPool::main_manager() { return main_thread()->worker
 uint64_t ThreadPool::nodes_searched() const { return accumulate(&Search::Worker::nodes); }
 uint64_t ThreadPool::tb_hits() const { return accumulate(&Search::Worker::tbHits); }
 
+// Sums the HARENN result cache hits and misses of all threads
+std::pair<uint64_t, uint64_t> ThreadPool::harenn_cache_stats() const {
+
+    uint64_t hits = 0, misses = 0;
+    for (auto&& th : threads)
+    {
+        hits += th->worker->harennCache.hits;
+        misses += th->worker->harennCache.misses;
+    }
+    return {hits, misses};
+}
+
+// Sums the HARENN search extension counters of all threads
+HARENN::ExtensionStats ThreadPool::harenn_extension_stats() const {
+
+    HARENN::ExtensionStats stats;
+    for (auto&& th : threads)
+    {
+        const HARENN::ExtensionStats& s = th->worker->harennExtensionStats;
+        stats.queried += s.queried;
+        stats.extended += s.extended;
+        stats.skipped += s.skipped;
+    }
+    return stats;
+}
+
+void ThreadPool::analyze(const std::vector<std::string>&                  fens,
+                         const Search::LimitsType&                        limits,
+                         const std::function<void(Search::AnalysisResult)>& onResult) {
+
+    main_thread()->wait_for_search_finished();
+
+    std::atomic<size_t> next{0};
+    for (auto&& th : threads)
+        th->run_custom_job([&, &worker = *th->worker]() {
+            for (size_t i; !stop && (i = next++) < fens.size();)
+                onResult(worker.analyze(i, fens[i], limits));
+        });
+
+    for (auto&& th : threads)
+        th->wait_for_search_finished();
+}
+
+// Wakes the thread in wait_for_stop_signal(). The mutex is taken so that a
+// change made just before the waiter goes to sleep cannot be missed.
+void ThreadPool::notify_stop_signal() {
+    {
+        std::lock_guard<std::mutex> lk(signalMutex);
+    }
+    signalCv.notify_all();
+}
+
+void ThreadPool::start_timer(const Search::LimitsType& limits) {
+    {
+        std::lock_guard<std::mutex> lk(signalMutex);
+        assert(!timerRunning);
+        timerLimits  = limits;
+        timerRunning = true;
+        ++timerSearches;
+    }
+
+    if (!timerThread)
+        timerThread = std::make_unique<NativeThread>(&ThreadPool::timer_loop, this);
+    else
+        signalCv.notify_all();
+}
+
+// Every change the timer makes happens under signalMutex after it checked
+// 'timerRunning', so it cannot touch the search once this returns
+void ThreadPool::stop_timer() {
+    {
+        std::lock_guard<std::mutex> lk(signalMutex);
+        timerRunning = false;
+    }
+    signalCv.notify_all();
+}
+
+// Between searches sleeps until start_timer(). During a search sleeps until
+// its next deadline or a notify_stop_signal(), so that 'ponderhit' and the
+// completion of the first iteration are seen at once.
+void ThreadPool::timer_loop() {
+    std::unique_lock<std::mutex> lk(signalMutex);
+    for (uint64_t search = 0;;)
+    {
+        signalCv.wait(lk, [&] { return timerExit || (timerRunning && timerSearches != search); });
+        if (timerExit)
+            return;
+
+        search = timerSearches;
+        const Search::LimitsType limits  = timerLimits;
+        Search::SearchManager&   manager = *main_manager();
+        // In 'nodes as time' mode the clock is the node count, which check_time() polls
+        const bool wallClock    = !limits.nodes && !limits.npmsec;
+        TimePoint  lastInfoTime = now();
+
+        while (timerRunning && timerSearches == search)
+        {
+            TimePoint tick = now();
+            if (tick - lastInfoTime >= 1000)
+            {
+                // Printed without the lock, which notify_stop_signal() needs
+                lastInfoTime = tick;
+                lk.unlock();
+                dbg_print();
+                lk.lock();
+                continue;
+            }
+
+            TimePoint wakeUp = lastInfoTime + 1000;
+            if (wallClock && !manager.ponder && !stop)
+            {
+                // Time left before the search must stop: past maximum(), or at once
+                // after a ponderhit that came when the time was already used
+                TimePoint elapsed = manager.tm.elapsed_time(), left = wakeUp - tick;
+                if (limits.use_time_management())
+                    left = std::min(left, manager.stopOnPonderhit ? 0 : manager.tm.maximum() + 1 - elapsed);
+                if (limits.movetime)
+                    left = std::min(left, limits.movetime - elapsed);
+
+                if (left <= 0 && manager.depthCompleted)
+                    stop = abortedSearch = true;
+                else if (left <= 0)
+                    wakeUp = TimePoint(-1);  // Until the first iteration completes
+                else
+                    wakeUp = tick + left;
+            }
+
+            if (wakeUp < 0)
+                signalCv.wait(lk);
+            else
+                signalCv.wait_until(lk, std::chrono::steady_clock::time_point(
+                                          std::chrono::milliseconds(wakeUp)));
+        }
+    }
+}
+
+// Sums the DEE hook counters of all threads
+DEE::Stats ThreadPool::dee_stats() const {
+
+    DEE::Stats stats;
+    for (auto&& th : threads)
+        stats += th->worker->deeStats;
+    return stats;
+}
+
+// Sums the TT counters of all threads
+TTStats ThreadPool::tt_stats() const {
+
+    TTStats stats;
+    for (auto&& th : threads)
+        stats += th->worker->ttStats;
+    return stats;
+}
+
+// Sums the DQRS trajectory stop counters of all threads
+DQRS::TrajectoryStats ThreadPool::trajectory_stats() const {
+
+    DQRS::TrajectoryStats stats = {};
+    for (auto&& th : threads)
+        stats += th->worker->trajectoryStats;
+    return stats;
+}
+
 static size_t next_power_of_two(uint64_t count) { return count > 1 ? (2ULL << msb(count - 1)) : 1; }
 
 // Creates/destroys threads to match the requested number.
@@ -293,7 +457,8 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
 
     main_thread()->wait_for_search_finished();
 
-    main_manager()->stopOnPonderhit = stop = abortedSearch = false;
+    main_manager()->stopOnPonderhit = main_manager()->depthCompleted = false;
+    stop = abortedSearch                                             = false;
     main_manager()->ponder                                 = limits.ponderMode;
 
     increaseDepth = true;
@@ -26,6 +26,8 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "memory.h"
@@ -124,6 +126,16 @@ class ThreadPool {
 
             threads.clear();
         }
+
+        if (timerThread)
+        {
+            {
+                std::lock_guard<std::mutex> lk(signalMutex);
+                timerExit = true;
+            }
+            signalCv.notify_all();
+            timerThread->join();
+        }
     }
 
     ThreadPool(const ThreadPool&) = delete;
@@ -145,11 +157,44 @@ class ThreadPool {
     Thread*                main_thread() const { return threads.front().get(); }
     uint64_t               nodes_searched() const;
     uint64_t               tb_hits() const;
+    std::pair<uint64_t, uint64_t> harenn_cache_stats() const;
+    HARENN::ExtensionStats        harenn_extension_stats() const;
+    DQRS::TrajectoryStats         trajectory_stats() const;
+    DEE::Stats                    dee_stats() const;
+    TTStats                       tt_stats() const;
     Thread*                get_best_thread() const;
     void                   start_searching();
     void                   wait_for_search_finished() const;
 
+    // Searches every position of 'fens' with 'limits' and returns when all
+    // are done. Each thread takes the next position as soon as it finishes
+    // one and searches it alone, while the TT and the shared histories stay
+    // shared. 'onResult' is called from the searching threads. The caller
+    // clears 'stop' beforehand, so that a stop raised meanwhile ends the run.
+    void analyze(const std::vector<std::string>&                  fens,
+                 const Search::LimitsType&                        limits,
+                 const std::function<void(Search::AnalysisResult)>& onResult);
+
+    // Blocks until 'pred' holds. The main thread waits here for 'stop' or
+    // 'ponderhit' once its search is over, and whoever changes the state
+    // tested by 'pred' calls notify_stop_signal().
+    template<typename Pred>
+    void wait_for_stop_signal(Pred pred) {
+        std::unique_lock<std::mutex> lk(signalMutex);
+        signalCv.wait(lk, pred);
+    }
+    void notify_stop_signal();
+
+    // Wake the thread beside the search that raises 'stop' when the wall clock
+    // limits of the main thread's TimeManagement run out. Limits counted in
+    // nodes are left to SearchManager::check_time(). The thread is created on
+    // the first search and sleeps between searches.
+    void start_timer(const Search::LimitsType& limits);
+    void stop_timer();
+
     std::vector<size_t> get_bound_thread_count_by_numa_node() const;
+    // The NUMA node of each thread, empty if the threads are not bound
+    const std::vector<NumaIndex>& get_bound_numa_nodes() const { return boundThreadToNumaNode; }
 
     void ensure_network_replicated();
 
@@ -166,6 +211,15 @@ class ThreadPool {
     StateListPtr                         setupStates;
     std::vector<std::unique_ptr<Thread>> threads;
     std::vector<NumaIndex>               boundThreadToNumaNode;
+    std::mutex                           signalMutex;
+    std::condition_variable              signalCv;
+    std::unique_ptr<NativeThread>        timerThread;
+    Search::LimitsType                   timerLimits;
+    uint64_t                             timerSearches = 0;  // numbers each start_timer()
+    bool                                 timerRunning  = false;
+    bool                                 timerExit     = false;
+
+    void timer_loop();
 
     uint64_t accumulate(std::atomic<uint64_t> Search::Worker::* member) const {
 
@@ -46,12 +46,14 @@ void TimeManagement::advance_nodes_time(std::int64_t nodes) {
 // the bounds of time allowed for the current game ply. We currently support:
 //      1) x basetime (+ z increment)
 //      2) x moves in y seconds (+ z increment)
-void TimeManagement::init(Search::LimitsType& limits,
-                          Color               us,
-                          int                 ply,
-                          const OptionsMap&   options,
-                          double&             originalTimeAdjust,
-                          const Position&     pos) {
+void TimeManagement::init(Search::LimitsType&             limits,
+                          Color                           us,
+                          int                             ply,
+                          const OptionsMap&               options,
+                          double&                         originalTimeAdjust,
+                          const Position&                 pos,
+                          const HARENN::GuidanceProvider& guidance,
+                          NumaReplicatedAccessToken       numaToken) {
     TimePoint npmsec = TimePoint(options["nodestime"]);
 
     // If we have no time, we don't need to fully initialize TM.
@@ -136,7 +138,8 @@ void TimeManagement::init(Search::LimitsType& limits,
 
     if (options["Use DEE/HARENN"] && options["Use HARE Time Management"])
     {
-        double mult = HARENN::Controller::get_time_multiplier(pos) / 100.0;
+        double mult = HARENN::Controller::get_time_multiplier(
+          guidance, HARENN::Controller::read_params(options), pos, numaToken) / 100.0;
         double timeLeftMs = (double)limits.time[us];
         // Safety: symmetric interpolation to 100% below 2000ms
         // Prevents both boosting AND starving at low time
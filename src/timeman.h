@@ -32,18 +32,25 @@ namespace Search {
 struct LimitsType;
 }
 
+namespace HARENN {
+class GuidanceProvider;
+}
+
+class NumaReplicatedAccessToken;
 class Position;
 
 // The TimeManagement class computes the optimal time to think depending on
 // the maximum available time, the game move number, and other parameters.
 class TimeManagement {
    public:
-    void init(Search::LimitsType& limits,
-              Color               us,
-              int                 ply,
-              const OptionsMap&   options,
-              double&             originalTimeAdjust,
-              const Position&     pos);
+    void init(Search::LimitsType&             limits,
+              Color                           us,
+              int                             ply,
+              const OptionsMap&               options,
+              double&                         originalTimeAdjust,
+              const Position&                 pos,
+              const HARENN::GuidanceProvider& guidance,
+              NumaReplicatedAccessToken       numaToken);
 
     TimePoint optimum() const;
     TimePoint maximum() const;
@@ -0,0 +1,586 @@
+#include "trainingdata.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+#include "analyze.h"
+#include "bitboard.h"
+#include "dee.h"
+#include "harenn.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "uci.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+        #define NOMINMAX  // Disable macros min() and max()
+    #endif
+    #include <windows.h>
+#endif
+
+namespace Stockfish::TrainingData {
+
+namespace {
+
+constexpr std::string_view PieceToChar(" PNBRQK  pnbrqk");
+
+constexpr CastlingRights Rights[] = {WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO};
+
+Piece piece_at(const PackedPosition& p, int n) {
+    return Piece((p.pieces[n / 2] >> (4 * (n % 2))) & 0xF);
+}
+
+uint16_t to_fixed(float x) { return uint16_t(std::lround(std::clamp(x, 0.0f, 1.0f) * 65535)); }
+
+}  // namespace
+
+bool pack(const Position& pos, int eval, float tau, float rho, float rs, PackedPosition& out) {
+    const Bitboard occupied = pos.pieces();
+    if (popcount(occupied) > 32)
+        return false;
+
+    out          = PackedPosition();
+    out.occupied = occupied;
+
+    int n = 0;
+    for (Bitboard b = occupied; b; ++n)
+        out.pieces[n / 2] |= uint8_t(pos.piece_on(pop_lsb(b)) << (4 * (n % 2)));
+
+    out.eval     = int16_t(std::clamp(eval, -32767, 32767));
+    out.tau      = to_fixed(tau);
+    out.rho      = to_fixed(rho);
+    out.rs       = to_fixed(rs);
+    out.fullmove = uint16_t(std::clamp(1 + (pos.game_ply() - (pos.side_to_move() == BLACK)) / 2, 1, 65535));
+    out.flags    = pos.side_to_move() == BLACK;
+    for (CastlingRights cr : Rights)
+        if (pos.can_castle(cr))
+            out.flags |= cr << 1;
+    out.epSquare = uint8_t(pos.ep_square());
+    out.rule50   = uint8_t(std::min(pos.rule50_count(), 255));
+    return true;
+}
+
+std::string fen(const PackedPosition& p) {
+    std::string s;
+
+    for (Rank r = RANK_8;; --r)
+    {
+        int empty = 0;
+        for (File f = FILE_A; f <= FILE_H; ++f)
+        {
+            const Square sq = make_square(f, r);
+            if (!(p.occupied & square_bb(sq)))
+            {
+                ++empty;
+                continue;
+            }
+            if (empty)
+                s += char('0' + empty);
+            empty = 0;
+            s += PieceToChar[piece_at(p, popcount(p.occupied & (square_bb(sq) - 1)))];
+        }
+        if (empty)
+            s += char('0' + empty);
+        if (r == RANK_1)
+            break;
+        s += '/';
+    }
+
+    s += p.flags & 1 ? " b " : " w ";
+    const std::size_t castling = s.size();
+    for (int i = 0; i < 4; ++i)
+        if (p.flags & (Rights[i] << 1))
+            s += "KQkq"[i];
+    if (s.size() == castling)
+        s += '-';
+
+    s += ' ';
+    s += p.epSquare == SQ_NONE ? "-" : UCIEngine::square(Square(p.epSquare));
+    s += ' ' + std::to_string(p.rule50) + ' ' + std::to_string(p.fullmove);
+    return s;
+}
+
+int features(const PackedPosition& p, int* activeFeatures) {
+    int n = 0;
+    for (Bitboard b = p.occupied; b; ++n)
+    {
+        const Square sq   = pop_lsb(b);
+        activeFeatures[n] = HARENN::feature_index(sq, piece_at(p, n));
+    }
+    return n;
+}
+
+// FNV-1a over 64-bit words rather than bytes, which keeps verification at
+// memory speed
+uint64_t checksum(const PackedPosition* records, std::size_t count) {
+    static_assert(sizeof(PackedPosition) % sizeof(uint64_t) == 0);
+
+    const char*       data  = reinterpret_cast<const char*>(records);
+    const std::size_t words = count * sizeof(PackedPosition) / sizeof(uint64_t);
+    uint64_t          h     = 14695981039346656037ull;
+    for (std::size_t i = 0; i < words; ++i)
+    {
+        uint64_t w;
+        std::memcpy(&w, data + i * sizeof(uint64_t), sizeof(uint64_t));
+        h = (h ^ w) * 1099511628211ull;
+    }
+    return h;
+}
+
+Writer::Writer(const std::string& path) :
+    file(std::fopen(path.c_str(), "wb")) {
+    buffer.reserve(ChunkRecords);
+
+    const FileHeader header = {{'H', 'T', 'P', '1'}, sizeof(PackedPosition), 0};
+    failed = !file || std::fwrite(&header, sizeof(header), 1, file) != 1;
+}
+
+void Writer::write(const PackedPosition& p) {
+    buffer.push_back(p);
+    if (buffer.size() == ChunkRecords)
+        flush();
+}
+
+void Writer::flush() {
+    if (buffer.empty() || !file)
+        return;
+
+    const ChunkHeader header = {uint32_t(buffer.size()), 0, checksum(buffer.data(), buffer.size())};
+    failed |= std::fwrite(&header, sizeof(header), 1, file) != 1;
+    failed |= std::fwrite(buffer.data(), sizeof(PackedPosition), buffer.size(), file) != buffer.size();
+    buffer.clear();
+    ++chunkCount;
+}
+
+bool Writer::close() {
+    if (file)
+    {
+        flush();
+        failed |= std::fclose(file) != 0;
+        file = nullptr;
+    }
+    return !failed;
+}
+
+bool Reader::open(const std::string& path) {
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1 || std::size_t(statbuf.st_size) < sizeof(FileHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    madvise(base, statbuf.st_size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(base);
+    size = statbuf.st_size;
+#else
+    HANDLE fd = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fd == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD size_high;
+    DWORD size_low = GetFileSize(fd, &size_high);
+    if ((uint64_t(size_high) << 32 | size_low) < sizeof(FileHeader))
+    {
+        CloseHandle(fd);
+        return false;
+    }
+
+    HANDLE mmap = CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
+    CloseHandle(fd);
+    if (!mmap)
+        return false;
+
+    void* base = MapViewOfFile(mmap, FILE_MAP_READ, 0, 0, 0);
+    if (!base)
+    {
+        CloseHandle(mmap);
+        return false;
+    }
+
+    mapping = mmap;
+    data    = static_cast<const char*>(base);
+    size    = (uint64_t(size_high) << 32) | size_low;
+#endif
+
+    // Both branches checked that the header fits
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "HTP1", 4) != 0 || header.recordSize != sizeof(PackedPosition))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Reader::close() {
+    if (!data)
+        return;
+
+#ifndef _WIN32
+    munmap(const_cast<char*>(data), size);
+#else
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+namespace {
+
+// Value of a numeric field of a flat JSON object, 'fallback' if it is missing
+double number_field(std::string_view object, std::string_view key, double fallback) {
+    const std::size_t k = object.find("\"" + std::string(key) + "\"");
+    if (k == std::string_view::npos)
+        return fallback;
+
+    const std::size_t colon = object.find(':', k);
+    if (colon == std::string_view::npos)
+        return fallback;
+
+    const std::string value(object.substr(colon + 1, 32));
+    return std::strtod(value.c_str(), nullptr);
+}
+
+std::string string_field(std::string_view object, std::string_view key) {
+    const std::size_t k = object.find("\"" + std::string(key) + "\"");
+    if (k == std::string_view::npos)
+        return {};
+
+    const std::size_t open  = object.find('"', object.find(':', k));
+    const std::size_t close = object.find('"', open + 1);
+    if (open == std::string_view::npos || close == std::string_view::npos)
+        return {};
+    return std::string(object.substr(open + 1, close - open - 1));
+}
+
+}  // namespace
+
+void convert(std::istream& args) {
+    using Clock = std::chrono::steady_clock;
+
+    std::string              output, token;
+    std::vector<std::string> inputs;
+    args >> output;
+    while (args >> token)
+        inputs.push_back(token);
+
+    if (output.empty() || inputs.empty())
+    {
+        sync_cout << "info string usage: convert <output> <input> [input ...]" << sync_endl;
+        return;
+    }
+
+    Writer      writer(output);
+    std::size_t converted = 0, skipped = 0;
+
+    for (const std::string& input : inputs)
+    {
+        std::ifstream in(input);
+        if (!in)
+        {
+            sync_cout << "info string convert: cannot open " << input << sync_endl;
+            continue;
+        }
+
+        // Objects are flat and may span lines. Every one with a "fen" key is a
+        // position; whatever follows the last complete object is kept.
+        std::string pending, line;
+        while (std::getline(in, line))
+        {
+            pending += line;
+            pending += '\n';
+
+            for (;;)
+            {
+                const std::size_t key = pending.find("\"fen\"");
+                if (key == std::string::npos)
+                {
+                    const std::size_t brace = pending.rfind('{');
+                    pending.erase(0, brace == std::string::npos ? pending.size() : brace);
+                    break;
+                }
+
+                const std::size_t end = pending.find('}', key);
+                if (end == std::string::npos)
+                    break;
+
+                const std::size_t begin = pending.rfind('{', key);
+                const std::string_view object(pending.data() + (begin == std::string::npos ? 0 : begin),
+                                              end - (begin == std::string::npos ? 0 : begin));
+
+                // Position::set() needs a board with one king of each colour
+                const std::string fen = Analysis::parse_fen(string_field(object, "fen"));
+
+                StateInfo      st;
+                Position       pos;
+                PackedPosition p;
+                bool           packed = !fen.empty();
+                if (packed)
+                {
+                    pos.set(fen, false, &st);
+                    packed = pack(pos, int(std::lround(number_field(object, "eval_score", 0))),
+                                  float(number_field(object, "tau", 0)),
+                                  float(number_field(object, "rho", 0)),
+                                  float(number_field(object, "rs", 0)), p);
+                }
+
+                if (packed)
+                {
+                    writer.write(p);
+                    ++converted;
+                }
+                else
+                    ++skipped;
+
+                pending.erase(0, end + 1);
+            }
+        }
+    }
+
+    const std::size_t chunks = (writer.close(), writer.chunks());
+    sync_cout << "info string convert: " << converted << " positions from " << inputs.size()
+              << " files into " << chunks << " chunks of " << output << " (" << skipped
+              << " skipped)" << sync_endl;
+
+    // Read the file back through the mapping, checking every chunk
+    Reader reader;
+    if (!reader.open(output))
+    {
+        sync_cout << "info string convert: failed to write " << output << sync_endl;
+        return;
+    }
+
+    std::size_t read = 0;
+    auto        t0   = Clock::now();
+    const bool  ok   = reader.for_each_chunk([&](const PackedPosition*, std::size_t n) { read += n; });
+    const double ms  = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    sync_cout << "info string convert: read back " << read << " positions, "
+              << (ok && read == converted ? "checksums ok" : "corrupt") << ", "
+              << read * sizeof(PackedPosition) / 1e6 / std::max(ms, 1e-3) << " GB/s" << sync_endl;
+}
+
+void unpack(std::istream& args) {
+    std::string input, output;
+    args >> input >> output;
+
+    if (input.empty() || output.empty())
+    {
+        sync_cout << "info string usage: unpack <input> <output>" << sync_endl;
+        return;
+    }
+
+    Reader reader;
+    if (!reader.open(input))
+    {
+        sync_cout << "info string unpack: cannot open " << input << sync_endl;
+        return;
+    }
+
+    std::ofstream out(output);
+    std::size_t   unpacked = 0;
+    out << std::fixed << std::setprecision(4);
+    const bool ok = reader.for_each_chunk([&](const PackedPosition* records, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const PackedPosition& p = records[i];
+            out << "{\"fen\": \"" << fen(p) << "\", \"tau\": " << label(p.tau)
+                << ", \"rho\": " << label(p.rho) << ", \"rs\": " << label(p.rs)
+                << ", \"eval_score\": " << p.eval << "}\n";
+        }
+        unpacked += n;
+    });
+
+    if (!out.flush())
+        sync_cout << "info string unpack: failed to write " << output << sync_endl;
+    else
+        sync_cout << "info string unpack: " << unpacked << " positions"
+                  << (ok ? "" : ", then a corrupt chunk") << sync_endl;
+}
+
+// Term for term as in analyzer.py, including the order of the floating point
+// operations, so that the rounded labels match the Python ones exactly
+StaticLabels static_labels(const Position& pos) {
+    const Color us = pos.side_to_move(), them = ~us;
+
+    int moves = 0, captures = 0;
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        ++moves;
+        captures += pos.capture(m);
+    }
+
+    const int kingAttackers = popcount(pos.attackers_to(pos.square<KING>(us)) & pos.pieces(them));
+
+    // Our pieces seen by more enemy pieces than they are defended by count
+    // their piece type, every other attacked one counts half
+    Bitboard usAttacks, themAttacks;
+    DEE::Evaluator::compute_both_attack_maps(pos, usAttacks, themAttacks);
+
+    double tension = 0;
+    for (Bitboard b = pos.pieces(us) & themAttacks; b;)
+    {
+        const Square   s         = pop_lsb(b);
+        const Bitboard attackers = pos.attackers_to(s);
+        tension += popcount(attackers & pos.pieces(them)) > popcount(attackers & pos.pieces(us))
+                   ? double(type_of(pos.piece_on(s)))
+                   : 0.5;
+    }
+
+    const double tau = moves / 60.0 * 0.2 + captures / 15.0 * 0.3 + kingAttackers / 4.0 * 0.2
+                     + std::min(1.0, tension / 10.0) * 0.3;
+    const double rho = pos.count<QUEEN>() * 0.3 + pos.count<ROOK>() * 0.15 + 0.2;
+    const double rs  = 1.0 - popcount(pos.pieces()) / 32.0;
+
+    return {std::clamp(tau, 0.0, 1.0), std::clamp(rho, 0.0, 1.0), std::clamp(rs, 0.0, 1.0)};
+}
+
+namespace {
+
+// Formats 'x' as Python's json.dumps(round(x, 4)): rounded half to even on
+// the exact binary value, without trailing zeros but with at least one decimal
+std::string python_round4(double x) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.4f", x);
+
+    std::string s(buf);
+    while (s.back() == '0' && s[s.size() - 2] != '.')
+        s.pop_back();
+    return s;
+}
+
+// Replaces the value of 'key' in a flat JSON object, or appends the field
+// before the closing brace if it is missing
+void set_field(std::string& object, std::string_view key, const std::string& value) {
+    const std::string quoted = "\"" + std::string(key) + "\"";
+    const std::size_t k      = object.find(quoted);
+
+    if (k == std::string::npos)
+    {
+        const std::size_t close = object.rfind('}');
+        object.insert(close, ", " + quoted + ": " + value);
+        return;
+    }
+
+    std::size_t begin = object.find(':', k) + 1;
+    while (begin < object.size() && object[begin] == ' ')
+        ++begin;
+    const std::size_t end = object.find_first_of(",}", begin);
+    object.replace(begin, end - begin, value);
+}
+
+// Relabels one line in place, returning false if it should be dropped
+bool relabel_line(std::string& line) {
+    if (line.find('}') == std::string::npos)
+        return false;
+
+    // Checked before Position::set(), which needs one king of each colour
+    const std::string fen = Analysis::parse_fen(string_field(line, "fen"));
+    if (fen.empty())
+        return false;
+
+    StateInfo st;
+    Position  pos;
+    pos.set(fen, false, &st);
+
+    const StaticLabels l = static_labels(pos);
+    set_field(line, "tau", python_round4(l.tau));
+    set_field(line, "rho", python_round4(l.rho));
+    set_field(line, "rs", python_round4(l.rs));
+    return true;
+}
+
+}  // namespace
+
+void relabel(std::istream& args) {
+    constexpr std::size_t BlockLines = 1 << 16;
+
+    std::string input, output;
+    int         threads = std::max(int(std::thread::hardware_concurrency()), 1);
+    args >> input >> output;
+    const bool validThreads = (args >> std::ws).eof() || ((args >> threads) && threads >= 1);
+
+    std::ifstream in(input);
+    std::ofstream out;
+    if (!input.empty() && !output.empty() && validThreads && in)
+        out.open(output);
+    if (!out.is_open())
+    {
+        sync_cout << "info string usage: relabel <input> <output> [threads]" << sync_endl;
+        return;
+    }
+
+    // Lines are read and written a block at a time, each block split into one
+    // contiguous range per thread, so the output keeps the input order.
+    const TimePoint          start = now();
+    std::size_t              kept = 0, dropped = 0;
+    std::vector<std::string> lines(BlockLines);
+    std::vector<char>        keep(BlockLines);
+
+    for (std::size_t count = BlockLines; count == BlockLines;)
+    {
+        for (count = 0; count < BlockLines && std::getline(in, lines[count]); ++count)
+        {}
+
+        const std::size_t        range = (count + threads - 1) / threads;
+        std::vector<std::thread> pool;
+        for (std::size_t begin = 0; begin < count; begin += range)
+            pool.emplace_back([&, begin]() {
+                for (std::size_t i = begin; i < std::min(begin + range, count); ++i)
+                    keep[i] = relabel_line(lines[i]);
+            });
+
+        for (auto& th : pool)
+            th.join();
+
+        for (std::size_t i = 0; i < count; ++i)
+            if (keep[i])
+            {
+                out << lines[i] << '\n';
+                ++kept;
+            }
+            else
+                dropped += !lines[i].empty();
+    }
+
+    const TimePoint elapsed = now() - start + 1;
+    if (!out.flush())
+        sync_cout << "info string relabel: failed to write " << output << sync_endl;
+    else
+        sync_cout << "info string relabel: " << kept << " positions (" << dropped << " dropped) in "
+                  << elapsed / 1000.0 << " s, " << 1000.0 * kept / elapsed << " positions/s"
+                  << sync_endl;
+}
+
+}  // namespace Stockfish::TrainingData
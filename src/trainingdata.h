@@ -0,0 +1,169 @@
+#ifndef TRAININGDATA_H_INCLUDED
+#define TRAININGDATA_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace Stockfish {
+
+class Position;
+
+namespace TrainingData {
+
+// A labelled position in a fixed 40-byte record. The board is the occupancy
+// bitboard plus one 4-bit Piece per occupied square, from a1 upwards, so a
+// record holds at most 32 pieces. Labels are stored as in the JSONL corpus:
+// eval in centipawns from the side to move, tau/rho/rs in [0, 1] scaled to 65535.
+struct PackedPosition {
+    uint64_t occupied;
+    uint8_t  pieces[16];  // low nibble first
+    int16_t  eval;
+    uint16_t tau, rho, rs;
+    uint16_t fullmove;
+    uint8_t  flags;     // bit 0: black to move, bits 1-4: CastlingRights
+    uint8_t  epSquare;  // SQ_NONE if there is no en passant square
+    uint8_t  rule50;
+    uint8_t  reserved[3];
+};
+
+static_assert(sizeof(PackedPosition) == 40);
+
+// Returns false if the position has more than 32 pieces
+bool pack(const Position& pos, int eval, float tau, float rho, float rs, PackedPosition& out);
+
+std::string fen(const PackedPosition& p);
+
+// Fills the HARENN input features of the position and returns their count
+int features(const PackedPosition& p, int* activeFeatures);
+
+inline float label(uint16_t v) { return v / 65535.0f; }
+
+// Container layout, in host byte order (little endian on supported targets) and
+// 8-byte aligned so that a mapped file can be read in place:
+//   FileHeader, then chunks of ChunkHeader followed by 'count' records
+struct FileHeader {
+    char     magic[4];  // "HTP1"
+    uint32_t recordSize;
+    uint64_t reserved;
+};
+
+struct ChunkHeader {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t checksum;  // of the records, see checksum()
+};
+
+constexpr std::size_t ChunkRecords = 65536;
+
+uint64_t checksum(const PackedPosition* records, std::size_t count);
+
+// Appends records to a new file, a chunk at a time
+class Writer {
+   public:
+    explicit Writer(const std::string& path);
+    ~Writer() { close(); }
+
+    Writer(const Writer&)            = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void write(const PackedPosition& p);
+    // Flushes the last chunk. Returns false if any write failed.
+    bool close();
+
+    std::size_t chunks() const { return chunkCount; }
+
+   private:
+    void flush();
+
+    std::FILE*                  file;
+    std::vector<PackedPosition> buffer;
+    std::size_t                 chunkCount = 0;
+    bool                        failed     = false;
+};
+
+// Read-only mapping of a file written by Writer. Records are used in place.
+class Reader {
+   public:
+    Reader() = default;
+    ~Reader() { close(); }
+
+    Reader(const Reader&)            = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Calls f(const PackedPosition* records, std::size_t count) for every
+    // chunk in file order. Returns false at the first truncated chunk or, if
+    // 'verify' is set, the first checksum mismatch.
+    template<typename F>
+    bool for_each_chunk(F&& f, bool verify = true) const {
+        std::size_t offset = sizeof(FileHeader);
+        while (offset < size)
+        {
+            if (size - offset < sizeof(ChunkHeader))
+                return false;
+
+            const auto* header = reinterpret_cast<const ChunkHeader*>(data + offset);
+            const auto* records =
+              reinterpret_cast<const PackedPosition*>(data + offset + sizeof(ChunkHeader));
+            offset += sizeof(ChunkHeader);
+
+            if ((size - offset) / sizeof(PackedPosition) < header->count)
+                return false;
+            if (verify && checksum(records, header->count) != header->checksum)
+                return false;
+
+            f(records, std::size_t(header->count));
+            offset += header->count * sizeof(PackedPosition);
+        }
+        return true;
+    }
+
+   private:
+    const char* data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+};
+
+// convert <output> <input> [input ...]
+//
+// Packs the positions of JSONL files (or JSON files holding a "positions"
+// array) into one container file and reads it back to verify it
+void convert(std::istream& args);
+
+// unpack <input> <output>
+//
+// Writes the records of a container file back as JSONL, one object per
+// position with the "fen", "tau", "rho", "rs" and "eval_score" keys of the
+// corpus and the labels rounded to 4 decimals. Stops at the first corrupt chunk.
+void unpack(std::istream& args);
+
+// The tau, rho and rs labels of analyzer.py's PositionAnalyzer
+struct StaticLabels {
+    double tau, rho, rs;
+};
+
+StaticLabels static_labels(const Position& pos);
+
+// relabel <input> <output> [threads]
+//
+// Rewrites the tau, rho and rs fields of every line of a JSONL file with
+// static_labels(), rounded to four decimals as relabel_batch.py writes them,
+// leaving the other fields as they are. Lines without a
+// usable FEN are dropped, as relabel_batch.py drops the lines it cannot parse.
+void relabel(std::istream& args);
+
+}  // namespace TrainingData
+
+}  // namespace Stockfish
+
+#endif  // TRAININGDATA_H_INCLUDED
@@ -18,12 +18,44 @@
 
 #include "tt.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-
+#include <numeric>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#else
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+        #define NOMINMAX  // Disable macros min() and max()
+    #endif
+    #include <windows.h>
+#endif
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    #include <sys/syscall.h>
+#endif
+
+#if defined(USE_AVX2)
+    #include <immintrin.h>
+#elif defined(USE_SSE2)
+    #include <emmintrin.h>
+#endif
+
+#include "bitboard.h"
 #include "memory.h"
 #include "misc.h"
 #include "syzygy/tbprobe.h"
@@ -32,9 +64,34 @@
 namespace Stockfish {
 
 
-// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+// The layout of the table is chosen at compile time ('make ttlayout=...'):
+// Key is the part of the position key an entry keeps to tell positions
+// apart, and ClusterSize entries and an epoch fill a cluster of ClusterBytes.
+//
+// compact: 3 entries of 10 bytes with a 16-bit key in 32 bytes, the densest
+// wide:    5 entries of 12 bytes with a 32-bit key in 64 bytes, which cuts
+//          the false hits of a very full table by a factor of 65536
+template<typename K, int Size, size_t Bytes>
+struct TTLayout {
+    using Key                            = K;
+    static constexpr int    ClusterSize  = Size;
+    static constexpr size_t ClusterBytes = Bytes;
+};
+
+#ifdef TT_LAYOUT_WIDE
+using Layout                             = TTLayout<uint32_t, 5, 64>;
+static constexpr const char* LayoutName = "wide";
+#else
+using Layout                             = TTLayout<uint16_t, 3, 32>;
+static constexpr const char* LayoutName = "compact";
+#endif
+
+using TTKey = Layout::Key;
+
+// TTEntry struct is the transposition table entry, 10 bytes in the compact
+// layout, defined as below:
 //
-// key        16 bit
+// key        16 bit (32 bit in the wide layout)
 // depth       8 bit
 // generation  5 bit
 // pv node     1 bit
@@ -56,14 +113,15 @@ struct TTEntry {
     }
 
     bool is_occupied() const;
-    void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
+    bool save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
     // The returned age is a multiple of TranspositionTable::GENERATION_DELTA
     uint8_t relative_age(const uint8_t generation8) const;
 
    private:
     friend class TranspositionTable;
+    friend struct TTWriter;
 
-    uint16_t key16;
+    TTKey    keyBits;
     uint8_t  depth8;
     uint8_t  genBound8;
     Move     move16;
@@ -90,26 +148,30 @@ bool TTEntry::is_occupied() const { return bool(depth8); }
 
 // Populates the TTEntry with a new node's data, possibly
 // overwriting an old position. The update is not atomic and can be racy.
-void TTEntry::save(
+// Returns whether the data was written, not only the move.
+bool TTEntry::save(
   Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
 
     // Preserve the old ttmove if we don't have a new one
-    if (m || uint16_t(k) != key16)
+    if (m || TTKey(k) != keyBits)
         move16 = m;
 
     // Overwrite less valuable entries (cheapest checks first)
-    if (b == BOUND_EXACT || uint16_t(k) != key16 || d - DEPTH_ENTRY_OFFSET + 2 * pv > depth8 - 4
+    if (b == BOUND_EXACT || TTKey(k) != keyBits || d - DEPTH_ENTRY_OFFSET + 2 * pv > depth8 - 4
         || relative_age(generation8))
     {
         assert(d > DEPTH_ENTRY_OFFSET);
         assert(d < 256 + DEPTH_ENTRY_OFFSET);
 
-        key16     = uint16_t(k);
+        keyBits   = TTKey(k);
         depth8    = uint8_t(d - DEPTH_ENTRY_OFFSET);
         genBound8 = uint8_t(generation8 | uint8_t(pv) << 2 | b);
         value16   = int16_t(v);
         eval16    = int16_t(ev);
+        return true;
     }
+
+    return false;
 }
 
 
@@ -123,35 +185,259 @@ uint8_t TTEntry::relative_age(const uint8_t generation8) const {
 }
 
 
-// TTWriter is but a very thin wrapper around the pointer
-TTWriter::TTWriter(TTEntry* tte) :
-    entry(tte) {}
+// A TranspositionTable is an array of Cluster, of size clusterCount. Each cluster consists of ClusterSize number
+// of TTEntry. Each non-empty TTEntry contains information on exactly one position. The size of a Cluster should
+// divide the size of a cache line for best performance, as the cacheline is prefetched when possible.
+
+static constexpr int ClusterSize = Layout::ClusterSize;
+
+// One cluster in KeySampleStride keeps the whole keys, see sample_keys()
+static constexpr size_t KeySampleStride = 64;
+
+struct alignas(Layout::ClusterBytes) Cluster {
+    TTEntry  entry[ClusterSize];
+    uint16_t epoch;
+};
 
+static_assert(sizeof(TTEntry) == sizeof(TTKey) + 8, "Unexpected TTEntry padding");
+static_assert(sizeof(TTEntry) % sizeof(TTKey) == 0, "Keys must be aligned for match_keys()");
+static_assert(sizeof(Cluster) == Layout::ClusterBytes, "Suboptimal Cluster size");
+
+
+// TTWriter is but a very thin wrapper around the pointer
+TTWriter::TTWriter(TTEntry* tte, TTStats* s, Key* sk, Cluster* c, uint16_t e) :
+    entry(tte),
+    stats(s),
+    sampledKey(sk),
+    stale(c),
+    epoch(e) {}
+
+// A cluster of an older epoch, see TranspositionTable::clear(), is emptied
+// by the first write to it. Like the write itself this is racy: two threads
+// that find the cluster stale at once may both empty it, and the later one
+// then drops the entry the earlier one has just written.
 void TTWriter::write(
   Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
-    entry->save(k, v, pv, b, d, m, ev, generation8);
+
+    if (stale && stale->epoch != epoch)
+    {
+        std::memset(stale->entry, 0, sizeof(stale->entry));
+        stale->epoch = epoch;
+    }
+
+    if (!stats)
+    {
+        if (entry->save(k, v, pv, b, d, m, ev, generation8) && sampledKey)
+            *sampledKey = k;
+        return;
+    }
+
+    const bool  other = entry->is_occupied() && TTKey(k) != entry->keyBits;
+    const int   age   = entry->relative_age(generation8) / GENERATION_DELTA;
+    const Depth depth = entry->depth8 + DEPTH_ENTRY_OFFSET;
+
+    stats->writes++;
+    if (!entry->save(k, v, pv, b, d, m, ev, generation8))
+        stats->rejected++;
+    else
+    {
+        if (sampledKey)
+            *sampledKey = k;
+        if (other)
+        {
+            stats->replacedByAge[std::min(age, TTStats::AGE_NB - 1)]++;
+            stats->replacedByDepth[TTStats::depth_bucket(depth)]++;
+        }
+    }
 }
 
 
-// A TranspositionTable is an array of Cluster, of size clusterCount. Each cluster consists of ClusterSize number
-// of TTEntry. Each non-empty TTEntry contains information on exactly one position. The size of a Cluster should
-// divide the size of a cache line for best performance, as the cacheline is prefetched when possible.
+int TTStats::depth_bucket(Depth d) {
+    return d <= 0 ? 0 : d <= 16 ? (d + 3) / 4 : d <= 24 ? 5 : d <= 32 ? 6 : 7;
+}
+
+TTStats& TTStats::operator+=(const TTStats& s) {
+    for (int i = 0; i < PROBE_NB; ++i)
+        hits[i] += s.hits[i], misses[i] += s.misses[i];
+    for (int i = 0; i < AGE_NB; ++i)
+        replacedByAge[i] += s.replacedByAge[i];
+    for (int i = 0; i < DEPTH_NB; ++i)
+        replacedByDepth[i] += s.replacedByDepth[i], occupied[i] += s.occupied[i];
+
+    writes += s.writes;
+    rejected += s.rejected;
+    sampledHits += s.sampledHits;
+    falseHits += s.falseHits;
+    sampledEntries += s.sampledEntries;
+    return *this;
+}
+
+void TTStats::print(std::ostream& os) const {
+    static const char* Ages[AGE_NB]     = {"0", "1", "2", "3+"};
+    static const char* Depths[DEPTH_NB] = {"<=0", "1-4", "5-8", "9-12", "13-16", "17-24", "25-32", "33+"};
+
+    auto percent = [](uint64_t n, uint64_t total) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(1) << (total ? 100.0 * n / total : 0.0) << '%';
+        return ss.str();
+    };
+    auto histogram = [&](const char* const* names, const uint64_t* counts, int size) {
+        const uint64_t total = std::accumulate(counts, counts + size, uint64_t(0));
+        for (int i = 0; i < size; ++i)
+            os << ' ' << names[i] << ": " << percent(counts[i], total);
+    };
+
+    const uint64_t replaced = std::accumulate(replacedByAge, replacedByAge + AGE_NB, uint64_t(0));
+    const uint64_t inUse    = std::accumulate(occupied, occupied + DEPTH_NB, uint64_t(0));
+
+    os << "tt probes: search " << hits[SearchProbe] + misses[SearchProbe] << " (hits "
+       << percent(hits[SearchProbe], hits[SearchProbe] + misses[SearchProbe]) << "), qsearch "
+       << hits[QSearchProbe] + misses[QSearchProbe] << " (hits "
+       << percent(hits[QSearchProbe], hits[QSearchProbe] + misses[QSearchProbe]) << ")\n";
+
+    os << "tt writes: " << writes << " (rejected " << percent(rejected, writes)
+       << "), entries of other positions replaced: " << replaced << '\n';
+
+    os << "tt replaced by age:";
+    histogram(Ages, replacedByAge, AGE_NB);
+    os << "\ntt replaced by depth:";
+    histogram(Depths, replacedByDepth, DEPTH_NB);
+
+    os << "\ntt false hits: " << falseHits << " of " << sampledHits << " sampled hits";
+    if (sampledHits)
+        os << " (" << std::defaultfloat << std::setprecision(3)
+           << double(falseHits) / sampledHits << ")";
+
+    os << "\ntt occupancy by depth:";
+    histogram(Depths, occupied, DEPTH_NB);
+    os << " (" << percent(inUse, sampledEntries) << " of " << sampledEntries
+       << " sampled entries in use)\n";
+}
+
 
-static constexpr int ClusterSize = 3;
+namespace {
 
-struct Cluster {
-    TTEntry entry[ClusterSize];
-    char    padding[2];  // Pad to 32 bytes
+// A bit for each byte of a cluster that starts a key-sized lane equal to
+// 'key': entry i matches if bit i * sizeof(TTEntry) is set. The keys of a
+// compact cluster take one compare with AVX2, those of a wide cluster two.
+uint64_t match_keys(const Cluster& cluster, TTKey key) {
+    uint64_t matches = 0;
+
+#if defined(USE_AVX2)
+    using Vec                = __m256i;
+    constexpr size_t VecSize = sizeof(Vec);
+    const Vec        k =
+      sizeof(TTKey) == 2 ? _mm256_set1_epi16(int16_t(key)) : _mm256_set1_epi32(int32_t(key));
+
+    for (size_t c = 0; c < sizeof(Cluster) / VecSize; ++c)
+    {
+        const Vec v  = _mm256_loadu_si256(reinterpret_cast<const Vec*>(&cluster) + c);
+        const Vec eq = sizeof(TTKey) == 2 ? _mm256_cmpeq_epi16(v, k) : _mm256_cmpeq_epi32(v, k);
+        matches |= uint64_t(uint32_t(_mm256_movemask_epi8(eq))) << (c * VecSize);
+    }
+#elif defined(USE_SSE2)
+    using Vec                = __m128i;
+    constexpr size_t VecSize = sizeof(Vec);
+    const Vec        k =
+      sizeof(TTKey) == 2 ? _mm_set1_epi16(int16_t(key)) : _mm_set1_epi32(int32_t(key));
+
+    for (size_t c = 0; c < sizeof(Cluster) / VecSize; ++c)
+    {
+        const Vec v  = _mm_loadu_si128(reinterpret_cast<const Vec*>(&cluster) + c);
+        const Vec eq = sizeof(TTKey) == 2 ? _mm_cmpeq_epi16(v, k) : _mm_cmpeq_epi32(v, k);
+        matches |= uint64_t(uint32_t(_mm_movemask_epi8(eq))) << (c * VecSize);
+    }
+#else
+    for (int i = 0; i < ClusterSize; ++i)
+        if (std::memcmp(&cluster.entry[i], &key, sizeof(key)) == 0)
+            matches |= 1ULL << (i * sizeof(TTEntry));
+#endif
+
+    return matches;
+}
+
+// The bits of match_keys() that are the keys of entries
+constexpr uint64_t EntryKeys = [] {
+    uint64_t keys = 0;
+    for (int i = 0; i < ClusterSize; ++i)
+        keys |= 1ULL << (i * sizeof(TTEntry));
+    return keys;
+}();
+
+// Whether probe() compares the keys with match_keys(). With the three keys
+// of the compact layout the unrolled loop measured faster.
+#if defined(USE_SSE2)
+constexpr bool VectorProbe = ClusterSize > 3;
+#else
+constexpr bool VectorProbe = false;
+#endif
+
+// Sets an interleaved memory policy over the memory nodes on the pages of
+// [mem, mem + size), which must not have been touched yet. False if there
+// is a single memory node, or no mbind().
+bool interleave([[maybe_unused]] void* mem, [[maybe_unused]] size_t size) {
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_mbind)
+    constexpr unsigned long MPOL_INTERLEAVE_ = 3;  // From <linux/mempolicy.h>
+    constexpr size_t        MaxNodes         = 1024;
+    constexpr size_t        Bits             = 8 * sizeof(unsigned long);
+
+    // A list of node ranges, such as "0-1,3"
+    std::ifstream in("/sys/devices/system/node/has_memory");
+    std::string   list;
+    if (!std::getline(in, list))
+        return false;
+
+    unsigned long      mask[MaxNodes / Bits] = {};
+    size_t             nodeCount             = 0;
+    std::istringstream ranges(list);
+
+    for (std::string range; std::getline(ranges, range, ',');)
+    {
+        const size_t dash  = range.find('-');
+        const size_t first = std::strtoul(range.c_str(), nullptr, 10);
+        const size_t last =
+          dash == std::string::npos ? first : std::strtoul(range.c_str() + dash + 1, nullptr, 10);
+
+        for (size_t n = first; n <= last && n < MaxNodes; ++n, ++nodeCount)
+            mask[n / Bits] |= 1UL << (n % Bits);
+    }
+
+    return nodeCount > 1
+        && syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE_, mask, MaxNodes + 1, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace
+
+// A snapshot file is this header, padded to SnapshotHeaderSize bytes so that
+// the clusters after it stay page aligned when the file is mapped, then the
+// clusters as they are in memory. The version changes with TTEntry's layout.
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t clusterBytes;
+    uint64_t clusterCount;
+    uint8_t  generation8;
+    uint16_t epoch;
 };
 
-static_assert(sizeof(Cluster) == 32, "Suboptimal Cluster size");
+constexpr char     SnapshotMagic[8]   = {'S', 'F', 'T', 'T', 'S', 'N', 'A', 'P'};
+constexpr uint32_t SnapshotVersion    = 2;
+constexpr size_t   SnapshotHeaderSize = 4096;
+
+static_assert(sizeof(SnapshotHeader) <= SnapshotHeaderSize);
 
 
 // Sets the size of the transposition table,
 // measured in megabytes. Transposition table consists
 // of clusters and each cluster consists of ClusterSize number of TTEntry.
-void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
-    aligned_large_pages_free(table);
+// The new table is zeroed by the threads in the background: their next job,
+// such as a search, starts only when they are done, and wait_for_zeroing()
+// waits for all of them. Must not be called while they still zero.
+void TranspositionTable::resize(size_t mbSize, ThreadPool& threads, Placement placement) {
+    free_table();
 
     clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
@@ -163,30 +449,91 @@ void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
         exit(EXIT_FAILURE);
     }
 
-    clear(threads);
+    if (placement == Interleave && !interleave(table, clusterCount * sizeof(Cluster)))
+    {
+        sync_cout << "info string TT Placement Interleave is not available, using FirstTouch"
+                  << sync_endl;
+        placement = FirstTouch;
+    }
+
+    if (!sampledKeys.empty())
+        sample_keys(true);
+
+    generation8   = 0;
+    epoch         = 0;
+    pagePlacement = placement;
+    zero(threads, placement);
 }
 
 
-// Initializes the entire transposition table to zero,
-// in a multi-threaded way.
+// Starts a new epoch instead of zeroing the table, so that a new game costs
+// nothing whatever the size: probe() reads a cluster of an older epoch as
+// empty, and the first write to it empties it. Only when the epoch wraps is
+// the table zeroed.
 void TranspositionTable::clear(ThreadPool& threads) {
-    generation8              = 0;
+    generation8 = 0;
+
+    if (++epoch == 0)
+        zero(threads, pagePlacement);
+}
+
+
+// Zeroes the table in a multi-threaded way, without waiting. Each thread
+// touches its part first, so that it is allocated on that thread's NUMA node.
+void TranspositionTable::zero(ThreadPool& threads, Placement placement) {
     const size_t threadCount = threads.num_threads();
 
+    // The part of the table each thread zeroes, as [begin, end)
+    std::vector<std::pair<size_t, size_t>> parts(threadCount);
     for (size_t i = 0; i < threadCount; ++i)
+        parts[i] = {clusterCount * i / threadCount, clusterCount * (i + 1) / threadCount};
+
+    const std::vector<NumaIndex>& nodes = threads.get_bound_numa_nodes();
+    if (placement == Striped && nodes.size() == threadCount)
     {
-        threads.run_on_thread(i, [this, i, threadCount]() {
-            // Each thread will zero its part of the hash table
-            const size_t stride = clusterCount / threadCount;
-            const size_t start  = stride * i;
-            const size_t len    = i + 1 != threadCount ? stride : clusterCount - start;
+        // Split the table among the nodes that have threads, then each
+        // stripe among the threads of its node
+        std::vector<NumaIndex> used(nodes);
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+
+        for (size_t s = 0; s < used.size(); ++s)
+        {
+            const size_t begin = clusterCount * s / used.size();
+            const size_t end   = clusterCount * (s + 1) / used.size();
+            const size_t count = size_t(std::count(nodes.begin(), nodes.end(), used[s]));
+
+            for (size_t i = 0, rank = 0; i < threadCount; ++i)
+                if (nodes[i] == used[s])
+                {
+                    parts[i] = {begin + (end - begin) * rank / count,
+                                begin + (end - begin) * (rank + 1) / count};
+                    ++rank;
+                }
+        }
+    }
 
-            std::memset(&table[start], 0, len * sizeof(Cluster));
-        });
+    {
+        std::lock_guard<std::mutex> lk(zeroMutex);
+        zeroJobs = threadCount;
     }
 
     for (size_t i = 0; i < threadCount; ++i)
-        threads.wait_on_thread(i);
+    {
+        threads.run_on_thread(i, [this, part = parts[i]]() {
+            std::memset(&table[part.first], 0, (part.second - part.first) * sizeof(Cluster));
+
+            std::lock_guard<std::mutex> lk(zeroMutex);
+            if (--zeroJobs == 0)
+                zeroCv.notify_all();
+        });
+    }
+}
+
+
+void TranspositionTable::wait_for_zeroing() {
+    std::unique_lock<std::mutex> lk(zeroMutex);
+    zeroCv.wait(lk, [&] { return zeroJobs == 0; });
 }
 
 
@@ -198,13 +545,57 @@ int TranspositionTable::hashfull(int maxAge) const {
     int cnt            = 0;
     for (int i = 0; i < 1000; ++i)
         for (int j = 0; j < ClusterSize; ++j)
-            cnt += table[i].entry[j].is_occupied()
+            cnt += table[i].epoch == epoch && table[i].entry[j].is_occupied()
                 && table[i].entry[j].relative_age(generation8) <= maxAgeInternal;
 
     return cnt / ClusterSize;
 }
 
 
+// The chance that a probe for a position not in the table still matches a
+// key, from the entries in use in the same clusters as hashfull() samples.
+// Each of them matches one key in 2^(key bits).
+double TranspositionTable::false_hit_rate() const {
+    int cnt = 0;
+    for (int i = 0; i < 1000; ++i)
+        for (int j = 0; j < ClusterSize; ++j)
+            cnt += table[i].epoch == epoch && table[i].entry[j].is_occupied();
+
+    return cnt / 1000.0 / std::pow(2.0, 8 * sizeof(TTKey));
+}
+
+
+// Counts the entries in use of up to 4096 clusters spread over the table,
+// by depth
+void TranspositionTable::occupancy(TTStats& stats) const {
+    const size_t samples = std::min(clusterCount, size_t(4096));
+
+    for (size_t i = 0; i < samples; ++i)
+    {
+        const Cluster& cluster = table[clusterCount * i / samples];
+        stats.sampledEntries += ClusterSize;
+
+        if (cluster.epoch == epoch)
+            for (const TTEntry& e : cluster.entry)
+                if (e.is_occupied())
+                    stats.occupied[TTStats::depth_bucket(e.depth8 + DEPTH_ENTRY_OFFSET)]++;
+    }
+}
+
+
+void TranspositionTable::sample_keys(bool on) {
+    const size_t size = (clusterCount + KeySampleStride - 1) / KeySampleStride * ClusterSize;
+    sampledKeys = on ? std::vector<Key>(size) : std::vector<Key>();
+}
+
+
+std::string TranspositionTable::layout() {
+    return std::string(LayoutName) + ", " + std::to_string(ClusterSize) + " x "
+         + std::to_string(sizeof(TTEntry)) + " byte entries with "
+         + std::to_string(8 * sizeof(TTKey)) + "-bit keys";
+}
+
+
 void TranspositionTable::new_search() {
     // increment by delta to keep lower bits as is
     generation8 += GENERATION_DELTA;
@@ -220,27 +611,98 @@ uint8_t TranspositionTable::generation() const { return generation8; }
 // to be replaced later. The replace value of an entry is calculated as its depth
 // minus 8 times its relative age. TTEntry t1 is considered more valuable than
 // TTEntry t2 if its replace value is greater than that of t2.
-std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key key) const {
+// A cluster left from before the last clear() is empty: the probe misses, and
+// the writer empties it before writing. probe() itself never writes.
+std::tuple<bool, TTData, TTWriter>
+TranspositionTable::probe(const Key key, TTStats* stats, TTStats::Probe type) const {
+
+    const size_t   index   = mul_hi64(key, clusterCount);
+    Cluster* const cluster = &table[index];
+    TTEntry* const tte     = &cluster->entry[0];
+    const TTKey    keyBits = TTKey(key);  // Use the low bits as key inside the cluster
+    TTEntry*       found   = nullptr;
+
+    if (cluster->epoch != epoch)
+    {
+        if (stats || !sampledKeys.empty())
+            return counted_probe(key, index, nullptr, true, stats, type);
 
-    TTEntry* const tte   = first_entry(key);
-    const uint16_t key16 = uint16_t(key);  // Use the low 16 bits as key inside the cluster
+        return {false,
+                TTData{Move::none(), VALUE_NONE, VALUE_NONE, DEPTH_ENTRY_OFFSET, BOUND_NONE, false},
+                TTWriter(tte, nullptr, nullptr, cluster, epoch)};
+    }
+
+    if constexpr (VectorProbe)
+    {
+        // The lowest match is the first matching entry, as the loop finds it
+        if (const uint64_t matches = match_keys(*cluster, keyBits) & EntryKeys)
+            found = &tte[int(lsb(matches)) / sizeof(TTEntry)];
+    }
+    else
+        for (int i = 0; i < ClusterSize; ++i)
+            if (tte[i].keyBits == keyBits)
+            {
+                found = &tte[i];
+                break;
+            }
+
+    if (stats || !sampledKeys.empty())
+        return counted_probe(key, index, found, false, stats, type);
+
+    if (found)
+        // This gap is the main place for read races.
+        // After `read()` completes that copy is final, but may be self-inconsistent.
+        return {found->is_occupied(), found->read(), TTWriter(found)};
+
+    return {false,
+            TTData{Move::none(), VALUE_NONE, VALUE_NONE, DEPTH_ENTRY_OFFSET, BOUND_NONE, false},
+            TTWriter(replacement(tte))};
+}
 
-    for (int i = 0; i < ClusterSize; ++i)
-        if (tte[i].key16 == key16)
-            // This gap is the main place for read races.
-            // After `read()` completes that copy is final, but may be self-inconsistent.
-            return {tte[i].is_occupied(), tte[i].read(), TTWriter(&tte[i])};
 
-    // Find an entry to be replaced according to the replacement strategy
+// Find an entry to be replaced according to the replacement strategy
+TTEntry* TranspositionTable::replacement(TTEntry* const tte) const {
     TTEntry* replace = tte;
     for (int i = 1; i < ClusterSize; ++i)
         if (replace->depth8 - replace->relative_age(generation8)
             > tte[i].depth8 - tte[i].relative_age(generation8))
             replace = &tte[i];
 
+    return replace;
+}
+
+
+// probe() with the counters and the key sampling on, kept apart so that
+// the usual path stays as it was
+std::tuple<bool, TTData, TTWriter> TranspositionTable::counted_probe(
+  Key key, size_t index, TTEntry* found, bool stale, TTStats* stats, TTStats::Probe type) const {
+
+    TTEntry* const tte   = &table[index].entry[0];
+    const bool     hit   = found && found->is_occupied();
+    TTEntry* const entry = found ? found : stale ? tte : replacement(tte);
+    Key* const     sampledKey =
+      !sampledKeys.empty() && index % KeySampleStride == 0
+              ? &sampledKeys[index / KeySampleStride * ClusterSize + size_t(entry - tte)]
+              : nullptr;
+
+    if (stats)
+    {
+        (hit ? stats->hits : stats->misses)[type]++;
+
+        // A key of 0 was not written since sampling started
+        if (hit && sampledKey && *sampledKey)
+        {
+            stats->sampledHits++;
+            stats->falseHits += *sampledKey != key;
+        }
+    }
+
+    if (found)
+        return {hit, found->read(), TTWriter(found, stats, sampledKey)};
+
     return {false,
             TTData{Move::none(), VALUE_NONE, VALUE_NONE, DEPTH_ENTRY_OFFSET, BOUND_NONE, false},
-            TTWriter(replace)};
+            TTWriter(entry, stats, sampledKey, stale ? &table[index] : nullptr, epoch)};
 }
 
 
@@ -248,4 +710,156 @@ TTEntry* TranspositionTable::first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
 }
 
+
+// Writes the header and the table to 'file'
+std::string TranspositionTable::save(const std::string& file) const {
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+        return "cannot create " + file;
+
+    char           header[SnapshotHeaderSize] = {};
+    SnapshotHeader h{};
+    std::memcpy(h.magic, SnapshotMagic, sizeof(h.magic));
+    h.version      = SnapshotVersion;
+    h.clusterBytes = sizeof(Cluster);
+    h.clusterCount = clusterCount;
+    h.generation8  = generation8;
+    h.epoch        = epoch;
+    std::memcpy(header, &h, sizeof(h));
+
+    out.write(header, SnapshotHeaderSize);
+    out.write(reinterpret_cast<const char*>(table), std::streamsize(clusterCount * sizeof(Cluster)));
+    out.close();
+
+    return out ? "" : "failed to write " + file;
+}
+
+
+// Replaces the table by a private mapping of 'file', after checking that the
+// snapshot fits the current size. Pages are read in as they are first probed,
+// and the writes of later searches never reach the file.
+std::string TranspositionTable::load(const std::string& file) {
+    const size_t   fileSize = SnapshotHeaderSize + clusterCount * sizeof(Cluster);
+    SnapshotHeader h;
+    {
+        std::ifstream in(file, std::ios::binary | std::ios::ate);
+        if (!in)
+            return "cannot open " + file;
+
+        const size_t size = size_t(in.tellg());
+        if (size < sizeof(h) || !in.seekg(0).read(reinterpret_cast<char*>(&h), sizeof(h))
+            || std::memcmp(h.magic, SnapshotMagic, sizeof(h.magic)))
+            return file + " is not a transposition table snapshot";
+
+        if (h.version != SnapshotVersion || h.clusterBytes != sizeof(Cluster))
+            return file + " was saved by an incompatible version or TT layout";
+
+        if (h.clusterCount != clusterCount)
+            return file + " needs Hash "
+                 + std::to_string(h.clusterCount * sizeof(Cluster) / (1024 * 1024));
+
+        if (size != fileSize)
+            return file + " is truncated";
+    }
+
+#ifndef _WIN32
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+        return "cannot open " + file;
+
+    void* base = ::mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return "cannot map " + file;
+
+    #ifdef MADV_WILLNEED
+    ::madvise(base, fileSize, MADV_WILLNEED);
+    #endif
+#else
+    HANDLE fd = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fd == INVALID_HANDLE_VALUE)
+        return "cannot open " + file;
+
+    HANDLE mmap = CreateFileMapping(fd, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(fd);
+    if (!mmap)
+        return "cannot map " + file;
+
+    void* base = MapViewOfFile(mmap, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mmap);
+    if (!base)
+        return "cannot map " + file;
+#endif
+
+    free_table();
+    if (!sampledKeys.empty())
+        sample_keys(true);
+
+    mapping     = base;
+    mappingSize = fileSize;
+    table       = reinterpret_cast<Cluster*>(static_cast<char*>(base) + SnapshotHeaderSize);
+    generation8 = h.generation8;
+    epoch       = h.epoch;
+
+    return "";
+}
+
+
+void TranspositionTable::free_table() {
+    if (mapping)
+    {
+#ifndef _WIN32
+        ::munmap(mapping, mappingSize);
+#else
+        UnmapViewOfFile(mapping);
+#endif
+        mapping     = nullptr;
+        mappingSize = 0;
+    }
+    else
+        aligned_large_pages_free(table);
+
+    table = nullptr;
+}
+
+
+// Each probe's key depends on what the previous probe read, so that the
+// cache misses of a thread cannot overlap and the time is their latency.
+// Only the load of the cluster is timed, which is what placement changes.
+double TranspositionTable::probe_latency(ThreadPool& threads, size_t probes) {
+    const size_t        threadCount = threads.num_threads();
+    std::vector<double> ns(threadCount);
+
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.run_on_thread(i, [this, i, probes, &ns]() {
+            PRNG rng(1070372 + i);
+            Key  key = rng.rand<Key>();
+
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t p = 0; p < probes; ++p)
+            {
+                // No branch on the entry, which would let the next probe
+                // start on a predicted value
+                const TTEntry* tte = first_entry(key);
+                key = (key ^ tte->keyBits ^ tte->genBound8) * 6364136223846793005ULL
+                    + 1442695040888963407ULL;
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+
+            [[maybe_unused]] volatile Key sink = key;  // Keeps the loop
+
+            ns[i] = std::chrono::duration<double, std::nano>(elapsed).count() / probes;
+        });
+
+    double sum = 0;
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads.wait_on_thread(i);
+        sum += ns[i];
+    }
+
+    return threadCount ? sum / threadCount : 0;
+}
+
 }  // namespace Stockfish
@@ -19,9 +19,15 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <tuple>
+#include <vector>
 
 #include "memory.h"
 #include "types.h"
@@ -66,6 +72,40 @@ struct TTData {
 };
 
 
+// Opt-in counters of the probes and writes of a thread, see the 'TT Stats'
+// option. The false hits are found in the clusters for which the table keeps
+// the whole key of each entry, see TranspositionTable::sample_keys(). The
+// occupancy is not counted but sampled from the table when asked for.
+struct TTStats {
+    enum Probe {
+        SearchProbe,
+        QSearchProbe,
+        PROBE_NB
+    };
+
+    static constexpr int AGE_NB   = 4;  // Relative ages 0, 1, 2 and 3 or more searches
+    static constexpr int DEPTH_NB = 8;
+
+    static int depth_bucket(Depth d);
+
+    uint64_t hits[PROBE_NB]   = {};
+    uint64_t misses[PROBE_NB] = {};
+    uint64_t writes           = 0;
+    uint64_t rejected         = 0;  // Writes that kept the entry's data
+    // Entries of other positions overwritten, by their relative age and depth
+    uint64_t replacedByAge[AGE_NB]     = {};
+    uint64_t replacedByDepth[DEPTH_NB] = {};
+    uint64_t sampledHits               = 0;
+    uint64_t falseHits                 = 0;  // Sampled hits on another position
+    uint64_t occupied[DEPTH_NB]        = {};
+    uint64_t sampledEntries            = 0;
+
+    void     clear() { *this = TTStats(); }
+    TTStats& operator+=(const TTStats& s);
+    void     print(std::ostream& os) const;  // One line per group of counters
+};
+
+
 // This is used to make racy writes to the global TT.
 struct TTWriter {
    public:
@@ -74,34 +114,92 @@ struct TTWriter {
    private:
     friend class TranspositionTable;
     TTEntry* entry;
-    TTWriter(TTEntry* tte);
+    TTStats* stats;
+    Key*     sampledKey;  // Where the whole key of the entry goes, if sampled
+    Cluster* stale;       // The cluster of 'entry' if it held an older epoch
+    uint16_t epoch;       // The current epoch, given to 'stale' when it is emptied
+    TTWriter(TTEntry* tte, TTStats* s = nullptr, Key* sk = nullptr, Cluster* c = nullptr, uint16_t e = 0);
 };
 
 
 class TranspositionTable {
 
    public:
-    ~TranspositionTable() { aligned_large_pages_free(table); }
-
-    void resize(size_t mbSize, ThreadPool& threads);  // Set TT size
-    void clear(ThreadPool& threads);                  // Re-initialize memory, multithreaded
+    // Where the pages of the table go on a NUMA machine. FirstTouch leaves
+    // each page on the node of the thread that zeroes it, and the threads
+    // zero equal parts. Interleave spreads the pages round-robin over the
+    // memory nodes (Linux only). Striped gives each node that has search
+    // threads an equal part, zeroed by its own threads.
+    enum Placement {
+        FirstTouch,
+        Interleave,
+        Striped
+    };
+
+    ~TranspositionTable() { free_table(); }
+
+    void resize(size_t mbSize, ThreadPool& threads, Placement placement = FirstTouch);
+    void clear(ThreadPool& threads);                  // Empty the table logically, see TTWriter::write()
+    void wait_for_zeroing();  // Blocks until the zeroing started by resize() is done
     int  hashfull(int maxAge = 0)
       const;  // Approximate what fraction of entries (permille) have been written to during this root search
+    double false_hit_rate() const;  // Estimated chance that a probe matches another position
+    void   occupancy(TTStats& stats) const;  // Sample the depths of the entries in use
+    // Keep the whole key of every entry of one cluster in KeySampleStride,
+    // for TTStats::falseHits. Kept across resize(), forgotten by load().
+    void sample_keys(bool on);
+    static std::string layout();    // The entry layout chosen at compile time
 
     void
     new_search();  // This must be called at the beginning of each root search to track entry aging
     uint8_t generation() const;  // The current age, used when writing new data to the TT
     std::tuple<bool, TTData, TTWriter>
-    probe(const Key key) const;  // The main method, whose retvals separate local vs global objects
+    probe(const Key key, TTStats* stats = nullptr, TTStats::Probe type = TTStats::SearchProbe)
+      const;  // The main method, whose retvals separate local vs global objects
     TTEntry* first_entry(const Key key)
       const;  // This is the hash function; its only external use is memory prefetching.
 
+    // Snapshots of the whole table and its generation, to keep it across
+    // restarts. A snapshot loads only into a table of the same size, and is
+    // mapped copy-on-write rather than read, so that it is usable at once.
+    // Both return an error message, empty on success, and must not be
+    // called during a search.
+    std::string save(const std::string& file) const;
+    std::string load(const std::string& file);
+
+    // Average time of a probe in ns, while every thread chases its own chain
+    // of 'probes' dependent probes at random keys
+    double probe_latency(ThreadPool& threads, size_t probes);
+
    private:
     friend struct TTEntry;
 
+    void     free_table();
+    void     zero(ThreadPool& threads, Placement placement);
+    TTEntry* replacement(TTEntry* const tte) const;
+    std::tuple<bool, TTData, TTWriter> counted_probe(
+      Key key, size_t index, TTEntry* found, bool stale, TTStats* stats, TTStats::Probe type) const;
+
     size_t   clusterCount;
     Cluster* table = nullptr;
 
+    // Clusters written before the last clear() hold an older epoch
+    uint16_t epoch = 0;
+
+    // The placement resize() used, for when clear() zeroes the table again
+    Placement pagePlacement = FirstTouch;
+
+    std::mutex              zeroMutex;
+    std::condition_variable zeroCv;
+    size_t                  zeroJobs = 0;  // Threads still zeroing their part of the table
+
+    void*  mapping     = nullptr;  // The snapshot file 'table' lies in, if loaded
+    size_t mappingSize = 0;
+
+    // ClusterSize keys per sampled cluster, 0 if unknown. Written by the
+    // writers that probe() hands out, as the table itself is.
+    mutable std::vector<Key> sampledKeys;
+
     uint8_t generation8 = 0;  // Size must be not bigger than TTEntry::genBound8
 };
 
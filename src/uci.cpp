@@ -29,13 +29,16 @@
 #include <utility>
 #include <vector>
 
+#include "analyze.h"
 #include "benchmark.h"
+#include "datagen.h"
 #include "engine.h"
 #include "memory.h"
 #include "movegen.h"
 #include "position.h"
 #include "score.h"
 #include "search.h"
+#include "trainingdata.h"
 #include "types.h"
 #include "ucioption.h"
 
@@ -81,7 +84,15 @@ void UCIEngine::init_search_update_listeners() {
     engine.set_on_update_no_moves([](const auto& i) { on_update_no_moves(i); });
     engine.set_on_update_full(
       [this](const auto& i) { on_update_full(i, engine.get_options()["UCI_ShowWDL"]); });
-    engine.set_on_bestmove([](const auto& bm, const auto& p) { on_bestmove(bm, p); });
+    engine.set_on_bestmove([this](const auto& bm, const auto& p) {
+        if (engine.get_options()["TT Stats"])
+        {
+            std::ostringstream ss;
+            engine.tt_stats().print(ss);
+            print_info_string(ss.str());
+        }
+        on_bestmove(bm, p);
+    });
     engine.set_on_verify_networks([](const auto& s) { print_info_string(s); });
 }
 
@@ -134,22 +145,94 @@ void UCIEngine::loop() {
         else if (token == "ucinewgame")
             engine.search_clear();
         else if (token == "isready")
+        {
+            engine.wait_for_tt();
             sync_cout << "readyok" << sync_endl;
+        }
 
         // Add custom non-UCI commands, mainly for debugging purposes.
         // These commands must not be used during a search!
         else if (token == "flip")
             engine.flip();
         else if (token == "bench")
-            bench(is);
+        {
+            // 'bench harenn [positions] [iterations]' times the HARENN model only
+            std::string args;
+            std::getline(is, args);
+            std::istringstream harenn(args), all(args);
+            if (harenn >> token && token == "harenn")
+            {
+                int positions = 0, iterations = 1000;
+                harenn >> positions >> iterations;
+                sync_cout << engine.bench_harenn(positions, iterations) << sync_endl;
+            }
+            else
+                bench(all);
+        }
         else if (token == BenchmarkCommand)
             benchmark(is);
         else if (token == "d")
             sync_cout << engine.visualize() << sync_endl;
         else if (token == "eval")
             engine.trace_eval();
+        else if (token == "dee")
+        {
+            if (is >> token && token == "stats")
+            {
+                std::ostringstream ss;
+                engine.dee_stats().print(ss);
+                sync_cout << ss.str() << sync_endl;
+            }
+        }
+        else if (token == "tt")
+        {
+            std::string file, error;
+            size_t      probes = 4000000;
+            if (is >> token && token == "bench")
+            {
+                is >> probes;
+                const double ns = engine.tt_probe_latency(probes);
+                sync_cout << "info string tt bench: " << int(engine.get_options()["Threads"])
+                          << " threads, " << probes << " probes per thread, " << ns
+                          << " ns per probe" << sync_endl;
+            }
+            else if ((token == "save" || token == "load") && is >> file)
+            {
+                error = token == "save" ? engine.save_tt(file) : engine.load_tt(file);
+                sync_cout << "info string tt " << token << ": " << (error.empty() ? file : error)
+                          << sync_endl;
+            }
+            else
+                sync_cout << "info string usage: tt save|load <file> | tt bench [probes]"
+                          << sync_endl;
+        }
         else if (token == "harenn")
-            engine.trace_harenn();
+        {
+            int iterations = 1000000;
+            if (is >> token && token == "bench")
+            {
+                is >> iterations;
+                sync_cout << engine.bench_harenn_heads(iterations) << sync_endl;
+            }
+            else if (token == "quantize")
+            {
+                std::string file = "nextfish.hnn5";
+                is >> file;
+                sync_cout << engine.quantize_harenn(file) << sync_endl;
+            }
+            else
+                engine.trace_harenn();
+        }
+        else if (token == "datagen")
+            Datagen::run(engine, cli.argv[0], is);
+        else if (token == "analyze")
+            Analysis::run(engine, is);
+        else if (token == "convert")
+            TrainingData::convert(is);
+        else if (token == "unpack")
+            TrainingData::unpack(is);
+        else if (token == "relabel")
+            TrainingData::relabel(is);
         else if (token == "compiler")
             sync_cout << compiler_info() << sync_endl;
         else if (token == "export_net")
@@ -292,7 +375,22 @@ void UCIEngine::bench(std::istream& args) {
     std::cerr << "\n==========================="    //
               << "\nTotal time (ms) : " << elapsed  //
               << "\nNodes searched  : " << nodes    //
-              << "\nNodes/second    : " << 1000 * nodes / elapsed << std::endl;
+              << "\nNodes/second    : " << 1000 * nodes / elapsed  //
+              << "\nTT layout       : " << engine.get_tt_layout()  //
+              << "\nTT false hits   : " << engine.get_tt_false_hit_rate()
+              << " per probe (estimated)" << std::endl;
+
+    if (options["DEE Stats"])
+        engine.dee_stats().print(std::cerr);
+
+    if (options["Use DQRS Trajectory Stop"])
+        engine.trajectory_stats().print(std::cerr);
+
+    if (options["TT Stats"])
+    {
+        std::cerr << '\n';
+        engine.tt_stats().print(std::cerr);
+    }
 
     // reset callback, to not capture a dangling reference to nodesSearched
     engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
@@ -380,6 +478,8 @@ void UCIEngine::benchmark(std::istream& args) {
 
     engine.search_clear();  // search_clear may take a while
 
+    TTStats ttStats;  // Of the games before the current one
+
     for (const auto& cmd : setup.commands)
     {
         std::istringstream is(cmd);
@@ -409,6 +509,7 @@ void UCIEngine::benchmark(std::istream& args) {
             position(is);
         else if (token == "ucinewgame")
         {
+            ttStats += engine.tt_stats();
             engine.search_clear();  // search_clear may take a while
         }
     }
@@ -453,6 +554,12 @@ void UCIEngine::benchmark(std::istream& args) {
 
     // clang-format on
 
+    if (engine.get_options()["TT Stats"])
+    {
+        std::cerr << '\n';
+        (ttStats += engine.tt_stats()).print(std::cerr);
+    }
+
     init_search_update_listeners();
 }
 
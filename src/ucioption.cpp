@@ -25,6 +25,7 @@
 #include <iostream>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "misc.h"
 
@@ -85,6 +86,19 @@ void OptionsMap::add(const std::string& name, const Option& option) {
 
 std::size_t OptionsMap::count(const std::string& name) const { return options_map.count(name); }
 
+void OptionsMap::copy_from(const OptionsMap& other, const std::vector<std::string>& except) {
+    std::vector<std::pair<size_t, std::string>> order;
+    for (const auto& [name, o] : options_map)
+        if (o.type != "button" && other.count(name)
+            && std::find(except.begin(), except.end(), name) == except.end())
+            order.emplace_back(o.idx, name);
+
+    std::sort(order.begin(), order.end());
+    for (const auto& [idx, name] : order)
+        if (options_map[name].currentValue != other[name].currentValue)
+            options_map[name] = other[name].currentValue;
+}
+
 Option::Option(const OptionsMap* map) :
     parent(map) {}
 
@@ -163,7 +177,8 @@ Option& Option::operator=(const std::string& v) {
         std::string        token;
         std::istringstream ss(defaultValue);
         while (ss >> token)
-            comboMap.add(token, Option());
+            if (!comboMap.count(token))  // The default is listed twice
+                comboMap.add(token, Option());
         if (!comboMap.count(v) || v == "var")
             return *this;
     }
@@ -25,6 +25,7 @@
 #include <map>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace Stockfish {
 // Define a custom comparator, because the UCI options should be case-insensitive
@@ -89,6 +90,11 @@ class OptionsMap {
 
     std::size_t count(const std::string&) const;
 
+    // Gives the options the values they have in 'other', in the order they were
+    // added. Buttons, the options named in 'except' and unchanged values are
+    // skipped, so only the on_change() actions of real changes run.
+    void copy_from(const OptionsMap& other, const std::vector<std::string>& except);
+
    private:
     friend class Engine;
     friend class Option;
@@ -0,0 +1,69 @@
+#!/bin/bash
+# verify that 'convert' packs a sample of a JSONL corpus file so that 'unpack'
+# gives back the same FENs and labels, and that a damaged file is refused
+
+error()
+{
+  echo "convert testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "convert testing started"
+
+CORPUS=${1:-../data/harenn_standard_24858315491.jsonl}
+SAMPLE=$(mktemp)
+PACKED=$(mktemp)
+OUTPUT=$(mktemp)
+LOG=$(mktemp)
+
+# FEN, then the labels as 'unpack' rounds them
+normalise()
+{
+  awk '{
+    match($0, /"fen": "[^"]*"/)
+    line = substr($0, RSTART + 8, RLENGTH - 9)
+    n = split("tau rho rs eval_score", keys, " ")
+    for (i = 1; i <= n; i++) {
+      match($0, "\"" keys[i] "\": [-0-9.e+]+")
+      value = substr($0, RSTART + length(keys[i]) + 4, RLENGTH - length(keys[i]) - 4)
+      line = line (i < n ? sprintf(" %.4f", value) : sprintf(" %d", value))
+    }
+    print line
+  }' "$1"
+}
+
+# more than one chunk of 65536 records
+head -n 70000 "$CORPUS" > "$SAMPLE"
+
+echo -n "Testing round trip... "
+printf 'convert %s %s\nunpack %s %s\nquit\n' "$PACKED" "$SAMPLE" "$PACKED" "$OUTPUT" | ./stockfish > "$LOG"
+grep -q "convert: 70000 positions from 1 files into 2 chunks" "$LOG"
+grep -q "read back 70000 positions, checksums ok" "$LOG"
+grep -q "unpack: 70000 positions$" "$LOG"
+diff <(normalise "$SAMPLE") <(normalise "$OUTPUT") > /dev/null
+echo "OK"
+
+echo -n "Testing invalid FENs... "
+printf '{"fen": "8/8/8/8/8/8/8/8 w - - 0 1", "tau": 0.5}\n{"fen": "", "tau": 0.5}\n' >> "$SAMPLE"
+printf '{"fen": "4k3/8/8/8/8/8/8/4K3 w K - 0 1", "tau": 0.5}\n' >> "$SAMPLE"
+printf 'convert %s %s\nquit\n' "$PACKED" "$SAMPLE" | ./stockfish > "$LOG"
+grep -q "convert: 70000 positions from 1 files into 2 chunks of .* (3 skipped)" "$LOG"
+echo "OK"
+
+echo -n "Testing a corrupt chunk... "
+byte=$(od -A n -t u1 -j 100 -N 1 "$PACKED")
+printf "\\$(printf %o $((255 - byte)))" | dd of="$PACKED" bs=1 seek=100 conv=notrunc 2> /dev/null
+printf 'unpack %s %s\nquit\n' "$PACKED" "$OUTPUT" | ./stockfish > "$LOG"
+grep -q "unpack: 0 positions, then a corrupt chunk" "$LOG"
+echo "OK"
+
+echo -n "Testing a truncated file... "
+head -c 10 "$SAMPLE" > "$PACKED"
+printf 'unpack %s %s\nquit\n' "$PACKED" "$OUTPUT" | ./stockfish > "$LOG"
+grep -q "unpack: cannot open" "$LOG"
+echo "OK"
+
+rm -f "$SAMPLE" "$PACKED" "$OUTPUT" "$LOG"
+
+echo "convert testing OK"
@@ -4,6 +4,7 @@ import sys
 import subprocess
 import pathlib
 import os
+import time
 
 from testing import (
     EPD,
@@ -147,6 +148,19 @@ class TestCLI(metaclass=OrderedClassMembers):
         )
         assert self.stockfish.process.returncode == 0
 
+    def test_analyze_bench_tmp_epd_depth_6(self):
+        self.stockfish = Stockfish(
+            f"analyze {os.path.join(PATH, 'bench_tmp.epd')} depth 6 threads {get_threads()}".split(
+                " "
+            ),
+            True,
+        )
+        assert self.stockfish.process.returncode == 0
+
+        results = [l for l in self.stockfish.process.stdout.splitlines() if l.startswith("{")]
+        assert len(results) == 4
+        assert all('"depth": 6,' in l for l in results)
+
     def test_d(self):
         self.stockfish = Stockfish("d".split(" "), True)
         assert self.stockfish.process.returncode == 0
@@ -411,6 +425,80 @@ class TestInteractive(metaclass=OrderedClassMembers):
 
         self.stockfish.send_command("setoption name Skill Level value 20")
 
+    def cpu_seconds(self):
+        with open(f"/proc/{self.stockfish.process.pid}/stat") as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+    # Once the depth limit is reached the engine must sleep, not spin, until
+    # 'signal' arrives, and then answer with bestmove at once
+    def check_wait_for_signal(self, go, signal):
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command(go)
+        self.stockfish.starts_with("info depth 1 ")
+        time.sleep(0.2)
+
+        if os.path.exists("/proc/self/stat"):
+            cpu = self.cpu_seconds()
+            time.sleep(1)
+            assert self.cpu_seconds() - cpu < 0.25
+
+        t0 = time.perf_counter()
+        self.stockfish.send_command(signal)
+        self.stockfish.starts_with("bestmove")
+        latency = time.perf_counter() - t0
+
+        print(f"bestmove {latency * 1e6:.0f} us after {signal}")
+        if not get_prefix():
+            assert latency < 0.05
+
+    def test_go_infinite_waits_for_stop(self):
+        self.check_wait_for_signal("go infinite depth 1", "stop")
+
+    def test_go_ponder_waits_for_ponderhit(self):
+        self.check_wait_for_signal("go ponder depth 1", "ponderhit")
+
+    def test_tt_snapshot_save_and_load(self):
+        snapshot = os.path.join(PATH, "tt_snapshot.tmp")
+
+        def search_nodes():
+            nodes = 0
+
+            def callback(output):
+                nonlocal nodes
+                match = re.match(r"info depth 10 .* nodes (\d+)", output)
+                if match:
+                    nodes = int(match.group(1))
+                return output.startswith("bestmove")
+
+            self.stockfish.send_command("go depth 10")
+            self.stockfish.check_output(callback)
+            return nodes
+
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("position startpos")
+        fresh = search_nodes()
+
+        self.stockfish.send_command(f"tt save {snapshot}")
+        self.stockfish.equals(f"info string tt save: {snapshot}")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command(f"tt load {snapshot}")
+        self.stockfish.equals(f"info string tt load: {snapshot}")
+
+        # The same search again finds the table it filled
+        loaded = search_nodes()
+        os.remove(snapshot)
+        assert 0 < loaded < fresh / 2, f"{loaded} nodes after tt load, {fresh} without"
+
+    def test_tt_stats_after_search(self):
+        self.stockfish.send_command("setoption name TT Stats value true")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 10")
+        self.stockfish.starts_with("info string tt probes: search")
+        self.stockfish.starts_with("info string tt occupancy by depth:")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("setoption name TT Stats value false")
+
 
 class TestSyzygy(metaclass=OrderedClassMembers):
     def beforeAll(self):
@@ -0,0 +1,37 @@
+#!/bin/bash
+# verify that 'relabel' reproduces the labels of analyzer.py / relabel_batch.py
+# on a sample of a corpus file labelled by the Python scripts
+
+error()
+{
+  echo "relabel testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "relabel testing started"
+
+CORPUS=${1:-../data/harenn_standard_24858315491.jsonl}
+SAMPLE=$(mktemp)
+OUTPUT=$(mktemp)
+
+head -n 20000 "$CORPUS" > "$SAMPLE"
+
+for threads in 1 3; do
+  echo -n "Testing $threads threads... "
+  printf 'relabel %s %s %s\nquit\n' "$SAMPLE" "$OUTPUT" "$threads" | ./stockfish > /dev/null
+  cmp "$SAMPLE" "$OUTPUT"
+  echo "OK"
+done
+
+echo -n "Testing an invalid castling right... "
+BROKEN=$(mktemp)
+cp "$SAMPLE" "$BROKEN"
+printf '{"fen": "4k3/8/8/8/8/8/8/4K3 w K - 0 1", "eval_score": 0}\n' >> "$BROKEN"
+printf 'relabel %s %s\nquit\n' "$BROKEN" "$OUTPUT" | ./stockfish | grep -q "relabel: .* (1 dropped)"
+cmp "$SAMPLE" "$OUTPUT"
+echo "OK"
+
+rm -f "$SAMPLE" "$OUTPUT" "$BROKEN"
+
+echo "relabel testing OK"